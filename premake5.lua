@@ -36,6 +36,51 @@ project "ClickSounds"
         links { "pthread", "m", "dl" }
         defines { "PLATFORM_LINUX" }
         
+    -- The AVX reverb kernel is only entered after a runtime CPU check
+    filter { "files:src/reverb_kernel_avx.cpp", "toolset:msc*" }
+        buildoptions { "/arch:AVX" }
+        
+    filter { "files:src/reverb_kernel_avx.cpp", "toolset:not msc*" }
+        buildoptions { "-mavx" }
+        
+    filter "configurations:Debug"
+        defines { "DEBUG" }
+        symbols "On"
+        
+    filter "configurations:Release"
+        defines { "NDEBUG" }
+        optimize "On"
+        
+    filter "action:gmake*"
+        toolset "clang"
+
+-- Packs decoded sound files into one file that ClickSounds maps at startup (audio.sound_pack)
+project "clicksounds-pack"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++17"
+    targetdir "bin/%{cfg.buildcfg}"
+    
+    files {
+        "tools/clicksounds_pack.cpp",
+        "src/sound_pack.h",
+        "src/sound_pack.cpp",
+        "src/miniaudio_impl.cpp",
+        "third_party/miniaudio/miniaudio.h"
+    }
+    
+    includedirs {
+        "src",
+        "third_party"
+    }
+    
+    filter "system:windows"
+        defines { "PLATFORM_WINDOWS" }
+    
+    filter "system:linux"
+        links { "pthread", "m", "dl" }
+        defines { "PLATFORM_LINUX" }
+        
     filter "configurations:Debug"
         defines { "DEBUG" }
         symbols "On"
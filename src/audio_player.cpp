@@ -6,87 +6,747 @@
 #include "audio_player.h"
 #include "config.h"
 
-#define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio/miniaudio.h"
-#include "miniaudio/ma_reverb_node.h"
+#include "effect_nodes.h"
+#include "key_layout.h"
 #include <algorithm>
 #include <chrono>
 #include <random>
 #include <iostream>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <thread>
 
 std::unique_ptr<AudioPlayer> AudioPlayer::create() {
     return std::make_unique<MiniaudioPlayer>();
 }
 
-bool MiniaudioPlayer::initialize() {
+MiniaudioPlayer::MiniaudioPlayer()
+    : stealPolicy_(VoiceStealPolicy::FADING_FIRST), effectsConfig_(std::make_unique<AudioEffectsConfig>()),
+      spatialRng_(std::random_device{}()), keyLayout_(std::make_unique<KeyLayout>()) {}
+
+// Short ramp used when a voice is cut off, long enough to avoid a click
+static const int kStopRampMs = 2;
+
+// miniaudio's per-node output cache (MA_DEFAULT_NODE_CACHE_CAP_IN_FRAMES_PER_BUS, which is only
+// defined where the implementation is compiled)
+static const ma_uint64 kNodeCacheFrames = 480;
+
+static const float kPi = 3.14159265358979323846f;
+static const int kStealRampMs = 3;
+
+// Replacing the effects chain crossfades old and new over this long
+static const int kEffectsCrossfadeMs = 50;
+// Splitter outputs, so a few chains can overlap while config saves come in quick succession
+static const ma_uint32 kEffectsChainSlots = 4;
+
+// One complete effects path from the shared input splitter to the endpoint: optional reverb, then
+// optional echo, then a sound group whose fader is used to crossfade when the chain is replaced
+struct EffectsChain {
+    ReverbNode* reverb = nullptr;
+    EchoNode* echo = nullptr;
+    ma_sound_group output;
+    bool outputInitialized = false;
+    ma_uint32 inputBus = 0;       // Splitter output feeding this chain
+    EchoLayout echoLayout;
+    ma_uint64 retireAtFrame = 0;  // Engine time after which a faded-out chain can be destroyed
+};
+
+// Input timestamps further in the past than this aren't on our clock (e.g. evdev records replayed
+// from a file keep their original times), so they're left out of the latency stats
+static const uint64_t kMaxInputLatencyUs = 1000000;
+
+// Sounds streamed from disk at once while the sample cache loads; more are dropped rather than
+// piling up file handles during a burst of typing
+static const size_t kMaxStreams = 16;
+
+// Data source behind every pooled voice. It reads straight from cached PCM and applies the
+// voice's gain ramps per frame inside the audio callback, so fades are sample accurate and
+// need no timer. Everything except fadeRequest belongs to the audio thread while the voice
+// is playing and to the control thread (under soundsMutex_) while it is idle.
+struct VoiceSource {
+    ma_data_source_base base;
+    const float* frames = nullptr;
+    const int16_t* frames16 = nullptr; // Instead of frames for samples stored as int16
+    ma_uint64 frameCount = 0;
+    ma_uint64 cursor = 0;
+    ma_uint32 channels = 2;
+    
+    float gain = 1.0f;
+    float gainStep = 0.0f;
+    float gainTarget = 1.0f;
+    ma_uint64 rampFramesLeft = 0;
+    bool endAfterRamp = false;
+    
+    // Constant-power pan for stereo voices in spatial_mode "pan", fixed for the whole sound
+    bool panned = false;
+    float panLeft = 1.0f;
+    float panRight = 1.0f;
+    
+    // Fade-out length in frames plus one, so zero means "no request"
+    std::atomic<ma_uint32> fadeRequest{0};
+    
+    int index = -1;
+    SpscQueue<int, kMaxVoices>* finished = nullptr;
+    
+    // Latency probes, set when the voice is started and checked on its first read
+    LatencyStats* latency = nullptr;
+    uint64_t inputUs = 0; // 0 when the play didn't come from a live input event
+    uint64_t startUs = 0;
+    bool rendered = false;
+    
+    // Peak of the last block this voice produced, after its gain ramp. Used to find the quietest voice,
+    // so it is only measured while the steal policy is QUIETEST (trackLevel, set when the voice starts)
+    std::atomic<float> level{0.0f};
+    bool trackLevel = false;
+};
+
+static ma_result voice_source_read(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead) {
+    VoiceSource* source = static_cast<VoiceSource*>(pDataSource);
+    float* out = static_cast<float*>(pFramesOut);
+    const ma_uint32 channels = source->channels;
+    
+    if (!source->rendered) {
+        source->rendered = true;
+        uint64_t now = LatencyStats::nowUs();
+        source->latency->record(LatencyStats::START_TO_RENDER, now - source->startUs);
+        if (source->inputUs != 0) {
+            source->latency->record(LatencyStats::INPUT_TO_RENDER, now - source->inputUs);
+        }
+    }
+    
+    // Pick up a fade-out scheduled since the last callback
+    ma_uint32 request = source->fadeRequest.exchange(0, std::memory_order_acquire);
+    if (request != 0) {
+        ma_uint64 fadeFrames = request - 1;
+        source->endAfterRamp = true;
+        source->rampFramesLeft = fadeFrames;
+        source->gainTarget = 0.0f;
+        source->gainStep = fadeFrames > 0 ? -source->gain / static_cast<float>(fadeFrames) : 0.0f;
+    }
+    
+    ma_uint64 available = source->frameCount - source->cursor;
+    if (source->endAfterRamp && source->rampFramesLeft < available) {
+        available = source->rampFramesLeft; // The voice ends when the fade-out does
+    }
+    ma_uint64 toRead = std::min(frameCount, available);
+    
+    const float* in;
+    if (source->frames16) {
+        // Widened into the output first, then scaled in place like f32 samples
+        const int16_t* in16 = source->frames16 + source->cursor * channels;
+        for (ma_uint64 i = 0; i < toRead * channels; i++) {
+            out[i] = in16[i] * (1.0f / 32768.0f);
+        }
+        in = out;
+    } else {
+        in = source->frames + source->cursor * channels;
+    }
+    ma_uint64 frame = 0;
+    
+    // Ramp portion, one gain value per frame
+    for (; frame < toRead && source->rampFramesLeft > 0; frame++) {
+        source->gain += source->gainStep;
+        source->rampFramesLeft--;
+        for (ma_uint32 c = 0; c < channels; c++) {
+            out[frame * channels + c] = in[frame * channels + c] * source->gain;
+        }
+    }
+    if (source->rampFramesLeft == 0) {
+        source->gain = source->gainTarget; // Don't let accumulated rounding linger
+    }
+    
+    if (source->panned) {
+        for (ma_uint64 i = 0; i < frame; i++) {
+            out[i * 2] *= source->panLeft;
+            out[i * 2 + 1] *= source->panRight;
+        }
+    }
+    
+    // Steady portion
+    const float gain = source->gain;
+    if (source->panned) {
+        const float left = gain * source->panLeft;
+        const float right = gain * source->panRight;
+        for (ma_uint64 i = frame; i < toRead; i++) {
+            out[i * 2] = in[i * 2] * left;
+            out[i * 2 + 1] = in[i * 2 + 1] * right;
+        }
+    } else if (gain == 1.0f) {
+        if (in != out) memcpy(out + frame * channels, in + frame * channels, (toRead - frame) * channels * sizeof(float));
+    } else {
+        for (ma_uint64 i = frame * channels; i < toRead * channels; i++) {
+            out[i] = in[i] * gain;
+        }
+    }
+    
+    if (source->trackLevel) {
+        float peak = 0.0f;
+        for (ma_uint64 i = 0; i < toRead * channels; i++) {
+            peak = std::max(peak, std::fabs(out[i]));
+        }
+        source->level.store(peak, std::memory_order_relaxed);
+    }
+    
+    source->cursor += toRead;
+    if (pFramesRead) *pFramesRead = toRead;
+    
+    bool ended = source->cursor >= source->frameCount || (source->endAfterRamp && source->rampFramesLeft == 0);
+    return (ended || toRead < frameCount) ? MA_AT_END : MA_SUCCESS;
+}
+
+static ma_result voice_source_seek(ma_data_source* pDataSource, ma_uint64 frameIndex) {
+    VoiceSource* source = static_cast<VoiceSource*>(pDataSource);
+    source->cursor = std::min(frameIndex, source->frameCount);
+    return MA_SUCCESS;
+}
+
+static ma_result voice_source_get_data_format(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels, ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap) {
+    VoiceSource* source = static_cast<VoiceSource*>(pDataSource);
+    if (pFormat) *pFormat = ma_format_f32;
+    if (pChannels) *pChannels = source->channels;
+    if (pSampleRate) *pSampleRate = 0; // Always the engine rate
+    if (pChannelMap) ma_channel_map_init_standard(ma_standard_channel_map_default, pChannelMap, channelMapCap, source->channels);
+    return MA_SUCCESS;
+}
+
+static ma_result voice_source_get_cursor(ma_data_source* pDataSource, ma_uint64* pCursor) {
+    *pCursor = static_cast<VoiceSource*>(pDataSource)->cursor;
+    return MA_SUCCESS;
+}
+
+static ma_result voice_source_get_length(ma_data_source* pDataSource, ma_uint64* pLength) {
+    *pLength = static_cast<VoiceSource*>(pDataSource)->frameCount;
+    return MA_SUCCESS;
+}
+
+static ma_data_source_vtable g_voice_source_vtable = {
+    voice_source_read,
+    voice_source_seek,
+    voice_source_get_data_format,
+    voice_source_get_cursor,
+    voice_source_get_length,
+    nullptr,
+    0
+};
+
+// Fired on the audio thread from the read that returned MA_AT_END. Stopping the node here rather
+// than on the next callback means the voice is fully quiescent once the control thread sees it.
+static void on_voice_end(void* pUserData, ma_sound* pSound) {
+    VoiceSource* source = static_cast<VoiceSource*>(pUserData);
+    ma_sound_stop(pSound);
+    source->finished->push(source->index);
+}
+
+// The engine renders straight into the device buffer, one engine read per device callback
+static void device_data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
+    (void)pInput;
+    ma_engine* engine = static_cast<ma_engine*>(*static_cast<void**>(pDevice->pUserData));
+    ma_engine_read_pcm_frames(engine, pOutput, frameCount, nullptr);
+}
+
+// Matches config names like "wasapi" or "coreaudio" against miniaudio's display names ("WASAPI", "Core Audio")
+static bool find_backend(const std::string& name, ma_backend* pBackend) {
+    auto normalize = [](const std::string& text) {
+        std::string result;
+        for (char c : text) {
+            if (std::isalnum(static_cast<unsigned char>(c))) {
+                result += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        return result;
+    };
+    
+    std::string wanted = normalize(name);
+    for (int i = 0; i <= ma_backend_null; i++) {
+        ma_backend backend = static_cast<ma_backend>(i);
+        if (normalize(ma_get_backend_name(backend)) == wanted) {
+            *pBackend = backend;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MiniaudioPlayer::initialize(const AudioLatencyConfig& latency) {
+    if (!openDevice(latency)) {
+        return false;
+    }
+    
+    ma_engine_config engineConfig = ma_engine_config_init();
+    engineConfig.pContext = static_cast<ma_context*>(context_);
+    engineConfig.pDevice = static_cast<ma_device*>(device_);
+    if (!initializeEngine(&engineConfig)) {
+        closeDevice();
+        return false;
+    }
+    return true;
+}
+
+bool MiniaudioPlayer::openDevice(const AudioLatencyConfig& latency) {
+    // Backend preference list. Unknown names are skipped, backends missing on this system fail over to the next
+    std::vector<ma_backend> backends;
+    for (const auto& name : latency.backends) {
+        ma_backend backend;
+        if (find_backend(name, &backend)) {
+            backends.push_back(backend);
+        } else {
+            std::cerr << "Unknown audio backend: " << name << std::endl;
+        }
+    }
+    
+    ma_context* context = new ma_context();
+    ma_result result = ma_context_init(backends.empty() ? nullptr : backends.data(),
+                                       static_cast<ma_uint32>(backends.size()), nullptr, context);
+    if (result != MA_SUCCESS) {
+        std::cerr << "Failed to initialize audio context (" << result << ")" << std::endl;
+        delete context;
+        return false;
+    }
+    context_ = context;
+    
+    ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
+    deviceConfig.playback.format = ma_format_f32;
+    deviceConfig.playback.channels = 0; // Native
+    deviceConfig.sampleRate = 0;
+    deviceConfig.periodSizeInFrames = static_cast<ma_uint32>(std::max(0, latency.periodFrames));
+    deviceConfig.periodSizeInMilliseconds = static_cast<ma_uint32>(std::max(0, latency.periodMs));
+    deviceConfig.periods = static_cast<ma_uint32>(std::max(0, latency.periods));
+    deviceConfig.performanceProfile = ma_performance_profile_low_latency;
+    deviceConfig.noPreSilencedOutputBuffer = MA_TRUE; // The engine writes every frame
+    deviceConfig.noClip = MA_TRUE; // The engine clips
+    deviceConfig.dataCallback = device_data_callback;
+    deviceConfig.pUserData = &engine_; // Read on the audio thread, which only starts once the engine exists
+    
+    // Find the requested device by name
+    ma_device_id deviceId;
+    if (!latency.device.empty()) {
+        ma_device_info* playbackInfos = nullptr;
+        ma_uint32 playbackCount = 0;
+        bool found = false;
+        if (ma_context_get_devices(context, &playbackInfos, &playbackCount, nullptr, nullptr) == MA_SUCCESS) {
+            for (ma_uint32 i = 0; i < playbackCount && !found; i++) {
+                if (std::string(playbackInfos[i].name).find(latency.device) != std::string::npos) {
+                    deviceId = playbackInfos[i].id;
+                    deviceConfig.playback.pDeviceID = &deviceId;
+                    found = true;
+                }
+            }
+        }
+        
+        if (!found) {
+            std::cerr << "Audio device \"" << latency.device << "\" not found, using the default. Available:" << std::endl;
+            for (ma_uint32 i = 0; i < playbackCount; i++) {
+                std::cerr << "  " << playbackInfos[i].name << std::endl;
+            }
+        }
+    }
+    
+    deviceConfig.playback.shareMode = latency.exclusiveMode ? ma_share_mode_exclusive : ma_share_mode_shared;
+    
+    ma_device* device = new ma_device();
+    result = ma_device_init(context, &deviceConfig, device);
+    if (result != MA_SUCCESS && latency.exclusiveMode) {
+        std::cerr << "Exclusive mode not available (" << result << "), falling back to shared mode" << std::endl;
+        deviceConfig.playback.shareMode = ma_share_mode_shared;
+        result = ma_device_init(context, &deviceConfig, device);
+    }
+    if (result != MA_SUCCESS) {
+        std::cerr << "Failed to open audio device (" << result << ")" << std::endl;
+        delete device;
+        closeDevice();
+        return false;
+    }
+    device_ = device;
+    
+    // Report what the backend actually gave us, which is often not what was asked for
+    ma_uint32 period = device->playback.internalPeriodSizeInFrames;
+    ma_uint32 periods = device->playback.internalPeriods;
+    ma_uint32 sampleRate = device->playback.internalSampleRate;
+    std::cout << "Audio device: " << device->playback.name << " via " << ma_get_backend_name(context->backend)
+              << (device->playback.shareMode == ma_share_mode_exclusive ? " (exclusive)" : " (shared)") << std::endl;
+    std::cout << "Audio buffer: " << periods << " x " << period << " frames at " << sampleRate << " Hz ("
+              << (sampleRate ? period * 1000.0 / sampleRate : 0.0) << " ms period, "
+              << (sampleRate ? periods * period * 1000.0 / sampleRate : 0.0) << " ms total)" << std::endl;
+    return true;
+}
+
+void MiniaudioPlayer::closeDevice() {
+    if (device_) {
+        ma_device_uninit(static_cast<ma_device*>(device_));
+        delete static_cast<ma_device*>(device_);
+        device_ = nullptr;
+    }
+    
+    if (context_) {
+        ma_context_uninit(static_cast<ma_context*>(context_));
+        delete static_cast<ma_context*>(context_);
+        context_ = nullptr;
+    }
+}
+
+bool MiniaudioPlayer::initializeOffline(uint32_t channels, uint32_t sampleRate) {
+    // No device: the engine only advances when renderFrames() pulls from it
+    ma_engine_config engineConfig = ma_engine_config_init();
+    engineConfig.noDevice = MA_TRUE;
+    engineConfig.channels = channels;
+    engineConfig.sampleRate = sampleRate;
+    return initializeEngine(&engineConfig);
+}
+
+uint64_t MiniaudioPlayer::renderFrames(float* output, uint64_t frameCount) {
+    if (!engine_) return 0;
+    
+    // The submix and effects splitters feed more than one consumer, and miniaudio only keeps those
+    // outputs in step while each graph pass fits in its per-node cache. A device always pulls exactly
+    // that much, so pull the same way here
+    ma_uint32 channels = ma_engine_get_channels(static_cast<ma_engine*>(engine_));
+    uint64_t totalRead = 0;
+    while (totalRead < frameCount) {
+        ma_uint64 chunk = std::min<uint64_t>(frameCount - totalRead, kNodeCacheFrames);
+        ma_uint64 framesRead = 0;
+        ma_engine_read_pcm_frames(static_cast<ma_engine*>(engine_), output + totalRead * channels, chunk, &framesRead);
+        totalRead += framesRead;
+        if (framesRead < chunk) break;
+    }
+    return totalRead;
+}
+
+uint32_t MiniaudioPlayer::getChannels() const {
+    return engine_ ? ma_engine_get_channels(static_cast<ma_engine*>(engine_)) : 0;
+}
+
+uint32_t MiniaudioPlayer::getSampleRate() const {
+    return engine_ ? ma_engine_get_sample_rate(static_cast<ma_engine*>(engine_)) : 0;
+}
+
+void MiniaudioPlayer::setRandomSeed(uint32_t seed) {
+    std::lock_guard<std::mutex> lock(soundsMutex_);
+    spatialRng_.seed(seed);
+}
+
+bool MiniaudioPlayer::initializeEngine(const void* engineConfig) {
     engine_ = new ma_engine();
-    delayNode_ = nullptr;
-    reverbNode_ = nullptr;
     
-    ma_result result = ma_engine_init(nullptr, static_cast<ma_engine*>(engine_));
+    ma_result result = ma_engine_init(static_cast<const ma_engine_config*>(engineConfig), static_cast<ma_engine*>(engine_));
     if (result != MA_SUCCESS) {
         delete static_cast<ma_engine*>(engine_);
         engine_ = nullptr;
         return false;
     }
     
+    // Decode samples at the engine format so playback is a plain memory read
+    ma_engine* engine = static_cast<ma_engine*>(engine_);
+    sampleCache_.setOutputFormat(ma_engine_get_channels(engine), ma_engine_get_sample_rate(engine));
+    
+    std::lock_guard<std::mutex> lock(soundsMutex_);
+    
+    // Wet sends all feed one splitter, and each output of the splitter can carry an effects chain.
+    // Start with an empty chain so sounds are audible before any effects config is applied
+    if (!createEffectsInput() || !(activeChain_ = createEffectsChain(*effectsConfig_, 0))) {
+        std::cerr << "Failed to create the effects input" << std::endl;
+    }
+    if (!createCategoryBuses()) {
+        std::cerr << "Failed to create the category submixes" << std::endl;
+    }
+    applyEffectSends();
+    
+    // All voices are created up front so playing a sound never allocates. Either category can use
+    // the whole limit, so each gets a full pool
+    for (int category = 0; category < kSoundCategoryCount; category++) {
+        if (!allocateVoices(static_cast<SoundCategory>(category), maxConcurrentSounds_ + kStealReserveVoices)) {
+            std::cerr << "Failed to allocate voice pool" << std::endl;
+        }
+    }
+    
     return true;
 }
 
+void MiniaudioPlayer::preloadSounds(const std::vector<std::string>& filepaths) {
+    printCacheSummary(sampleCache_.preload(filepaths));
+}
+
+void MiniaudioPlayer::preloadSoundsAsync(const std::vector<std::string>& filepaths, std::function<void()> onReady) {
+    sampleCache_.preloadAsync(filepaths, [this, onReady](int failed) {
+        printCacheSummary(failed);
+        if (onReady) onReady();
+    });
+}
+
+void MiniaudioPlayer::printCacheSummary(int failed) {
+    SampleCacheStats stats = sampleCache_.getStats();
+    std::cout << "Sample cache: " << stats.sampleCount - stats.packSamples << " sounds decoded ("
+              << stats.memoryBytes / 1024 << " KiB";
+    if (stats.int16Samples > 0) {
+        std::cout << ", " << stats.int16Samples << " as int16";
+    }
+    std::cout << ")";
+    if (stats.packSamples > 0) {
+        std::cout << ", " << stats.packSamples << " mapped from the sound pack";
+    }
+    if (stats.bytesSaved > 0) {
+        std::cout << ", " << stats.bytesSaved / 1024 << " KiB saved by trimming and int16 storage";
+    }
+    if (failed > 0) {
+        std::cout << ", " << failed << " failed to load";
+    }
+    std::cout << std::endl;
+}
+
+bool MiniaudioPlayer::setSampleLoading(const SampleLoadConfig& config) {
+    float threshold = config.trimSilence ? std::pow(10.0f, config.trimThresholdDb / 20.0f) : 0.0f;
+    return sampleCache_.setLoadOptions(threshold, config.format, config.normalizeLoudness, config.targetLoudnessDb);
+}
+
+void MiniaudioPlayer::forgetSounds(const std::vector<std::string>& filepaths) {
+    sampleCache_.forget(filepaths);
+}
+
+bool MiniaudioPlayer::setSoundPack(const std::string& path) {
+    // Switching packs empties the sample cache, so only do it when the pack is a different file
+    std::error_code error;
+    int64_t modified = path.empty() ? 0 : std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    if (path == soundPackPath_ && modified == soundPackModified_) return false;
+    soundPackPath_ = path;
+    soundPackModified_ = modified;
+    
+    std::shared_ptr<const SoundPack> pack = path.empty() ? nullptr : SoundPack::open(path);
+    if (sampleCache_.setPack(pack)) {
+        std::cout << "Sound pack: " << path << ", " << pack->size() << " samples ("
+                  << pack->mappedBytes() / 1024 << " KiB mapped)" << std::endl;
+    }
+    return true;
+}
+
+const LatencyStats& MiniaudioPlayer::getLatencyStats() const {
+    return latencyStats_;
+}
+
+SampleCacheStats MiniaudioPlayer::getCacheStats() const {
+    return sampleCache_.getStats();
+}
+
 void MiniaudioPlayer::setMaxConcurrentSounds(int maxSounds) {
     std::lock_guard<std::mutex> lock(soundsMutex_);
-    maxConcurrentSounds_ = maxSounds;
+    maxConcurrentSounds_ = std::max(1, std::min(maxSounds, kMaxVoices / kSoundCategoryCount - kStealReserveVoices));
+    
+    // Raising the limit after startup grows the pools once; lowering it just caps how many voices play
+    int poolSize = (maxConcurrentSounds_ + kStealReserveVoices) * kSoundCategoryCount;
+    if (engine_ && poolSize > static_cast<int>(voices_.size())) {
+        int grow = (poolSize - static_cast<int>(voices_.size())) / kSoundCategoryCount;
+        for (int category = 0; category < kSoundCategoryCount; category++) {
+            allocateVoices(static_cast<SoundCategory>(category), grow);
+        }
+    }
+}
+
+void MiniaudioPlayer::setVoiceStealPolicy(VoiceStealPolicy policy) {
+    std::lock_guard<std::mutex> lock(soundsMutex_);
+    stealPolicy_ = policy;
+}
+
+VoiceStats MiniaudioPlayer::getVoiceStats() {
+    std::lock_guard<std::mutex> lock(soundsMutex_);
+    cleanupFinishedSounds();
+    
+    VoiceStats stats;
+    stats.active = playingSounds();
+    stats.peakActive = peakActiveVoices_;
+    stats.steals = voiceSteals_;
+    stats.drops = voiceDrops_;
+    return stats;
 }
 
 void MiniaudioPlayer::setMasterVolume(float volume) {
-    masterVolume_ = std::max(0.0f, std::min(1.0f, volume));
+    masterVolume_.store(std::max(0.0f, std::min(1.0f, volume)), std::memory_order_relaxed);
 }
 
-int MiniaudioPlayer::getCurrentTimeMs() {
-#ifdef PLATFORM_WINDOWS
-    return GetTickCount();
-#else
-    auto now = std::chrono::steady_clock::now();
-    auto duration = now.time_since_epoch();
-    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
-#endif
+bool MiniaudioPlayer::allocateVoices(SoundCategory category, int count) {
+    ma_engine* engine = static_cast<ma_engine*>(engine_);
+    ma_uint32 channels = ma_engine_get_channels(engine);
+    
+    voices_.reserve(voices_.size() + count);
+    activeVoices_.reserve(voices_.size() + count);
+    
+    for (int i = 0; i < count; i++) {
+        Voice voice;
+        VoiceSource* source = new VoiceSource();
+        source->channels = channels;
+        source->index = static_cast<int>(voices_.size());
+        source->finished = &finishedVoices_;
+        source->latency = &latencyStats_;
+        
+        ma_data_source_config sourceConfig = ma_data_source_config_init();
+        sourceConfig.vtable = &g_voice_source_vtable;
+        ma_data_source_init(&sourceConfig, source);
+        
+        // Samples are already at the engine rate, so the resampler can be skipped entirely
+        ma_sound* sound = new ma_sound();
+        ma_result result = ma_sound_init_from_data_source(engine, source, MA_SOUND_FLAG_NO_PITCH, nullptr, sound);
+        if (result != MA_SUCCESS) {
+            delete sound;
+            ma_data_source_uninit(source);
+            delete source;
+            return false;
+        }
+        ma_sound_set_end_callback(sound, on_voice_end, source);
+        
+        // Routing never changes per play; effects are swapped behind the submixes instead
+        ma_splitter_node* bus = static_cast<ma_splitter_node*>(categoryBuses_[static_cast<int>(category)]);
+        if (bus) {
+            ma_node_attach_output_bus(sound, 0, bus, 0);
+        }
+        
+        voice.sound = sound;
+        voice.source = source;
+        voice.category = category;
+        voice.nextFree = freeVoices_[static_cast<int>(category)];
+        freeVoices_[static_cast<int>(category)] = static_cast<int>(voices_.size());
+        voices_.push_back(std::move(voice));
+    }
+    
+    return true;
+}
+
+void MiniaudioPlayer::destroyVoices() {
+    for (auto& voice : voices_) {
+        // The sound has to go first since it reads from the source
+        ma_sound_uninit(static_cast<ma_sound*>(voice.sound));
+        delete static_cast<ma_sound*>(voice.sound);
+        ma_data_source_uninit(voice.source);
+        delete static_cast<VoiceSource*>(voice.source);
+    }
+    voices_.clear();
+    activeVoices_.clear();
+    for (int& head : freeVoices_) {
+        head = -1;
+    }
+    stolenVoices_ = 0;
+    
+    int index;
+    while (finishedVoices_.pop(index)) {}
+}
+
+int MiniaudioPlayer::acquireVoice(SoundCategory category) {
+    int& head = freeVoices_[static_cast<int>(category)];
+    if (head < 0) return -1;
+    
+    int index = head;
+    Voice& voice = voices_[index];
+    head = voice.nextFree;
+    
+    voice.nextFree = -1;
+    voice.activeSlot = static_cast<int>(activeVoices_.size());
+    activeVoices_.push_back(index);
+    return index;
+}
+
+void MiniaudioPlayer::releaseVoice(int index) {
+    Voice& voice = voices_[index];
+    
+    // Swap-remove from the active list
+    int last = activeVoices_.back();
+    activeVoices_[voice.activeSlot] = last;
+    voices_[last].activeSlot = voice.activeSlot;
+    activeVoices_.pop_back();
+    
+    VoiceSource* source = static_cast<VoiceSource*>(voice.source);
+    source->frames = nullptr;
+    source->frames16 = nullptr;
+    source->frameCount = 0;
+    voice.sample.reset();
+    voice.fadingOut = false;
+    if (voice.stolen) {
+        voice.stolen = false;
+        stolenVoices_--;
+    }
+    voice.activeSlot = -1;
+    voice.generation = (voice.generation + 1) & kVoiceGenerationMask;
+    if (voice.generation == 0) voice.generation = 1;
+    
+    voice.nextFree = freeVoices_[static_cast<int>(voice.category)];
+    freeVoices_[static_cast<int>(voice.category)] = index;
+}
+
+Voice* MiniaudioPlayer::findVoice(int soundId) {
+    int index = soundId & (kMaxVoices - 1);
+    uint32_t generation = static_cast<uint32_t>(soundId) >> kVoiceIndexBits;
+    
+    if (index >= static_cast<int>(voices_.size())) return nullptr;
+    
+    Voice& voice = voices_[index];
+    if (voice.activeSlot < 0 || voice.generation != generation) return nullptr;
+    return &voice;
 }
 
 void MiniaudioPlayer::cleanupFinishedSounds() {
-    activeSounds_.erase(
-        std::remove_if(activeSounds_.begin(), activeSounds_.end(),
-            [](const SoundInstance& instance) {
-                ma_sound* sound = static_cast<ma_sound*>(instance.sound);
-                if (!ma_sound_is_playing(sound)) {
-                    ma_sound_uninit(sound);
-                    delete sound;
-                    return true;
-                }
-                return false;
-            }),
-        activeSounds_.end());
-}
-
-void MiniaudioPlayer::updateFadingSounds() {
-    int currentTime = getCurrentTimeMs();
-    
-    for (auto& instance : activeSounds_) {
-        if (instance.fadingOut) {
-            ma_sound* sound = static_cast<ma_sound*>(instance.sound);
-            int elapsed = currentTime - instance.fadeStartTime;
-            
-            if (elapsed >= instance.fadeDuration) {
-                // Fade complete, stop the sound
-                ma_sound_stop(sound);
-                instance.fadingOut = false;
-            } else {
-                // Calculate fade progress (0.0 to 1.0)
-                float progress = static_cast<float>(elapsed) / instance.fadeDuration;
-                float volume = instance.originalVolume * (1.0f - progress);
-                ma_sound_set_volume(sound, volume);
-            }
+    // Voices are handed back by the audio thread as they end, so nothing has to be polled
+    int index;
+    while (finishedVoices_.pop(index)) {
+        if (voices_[index].activeSlot >= 0) {
+            releaseVoice(index);
         }
     }
+    destroyStreams(true); // Streams are checked instead, but there are only any while the cache loads
+}
+
+// What counts against max_concurrent_sounds: voices that aren't being stolen, and streams
+int MiniaudioPlayer::playingSounds() const {
+    return static_cast<int>(activeVoices_.size() + streams_.size()) - stolenVoices_;
+}
+
+// Ramps one playing voice out to make room for a new sound. The victim keeps its slot (from the
+// reserve) until the audio thread finishes the ramp, but stops counting against the limit right away
+bool MiniaudioPlayer::stealVoice(int key) {
+    if (stealPolicy_ == VoiceStealPolicy::NONE) return false;
+    
+    int victim = -1;
+    float victimScore = 0.0f;
+    for (int index : activeVoices_) {
+        const Voice& voice = voices_[index];
+        if (voice.stolen) continue;
+        
+        // Lower score wins; ties (and the fallback for the preference policies) go to the oldest voice
+        float score = 0.0f;
+        switch (stealPolicy_) {
+            case VoiceStealPolicy::QUIETEST:
+                score = static_cast<VoiceSource*>(voice.source)->level.load(std::memory_order_relaxed) * voice.volume;
+                break;
+            case VoiceStealPolicy::FADING_FIRST:
+                score = voice.fadingOut ? 0.0f : 1.0f;
+                break;
+            case VoiceStealPolicy::SAME_KEY_FIRST:
+                score = (key >= 0 && voice.key == key) ? 0.0f : 1.0f;
+                break;
+            default:
+                break;
+        }
+        
+        if (victim < 0 || score < victimScore ||
+            (score == victimScore && voice.startOrder < voices_[victim].startOrder)) {
+            victim = index;
+            victimScore = score;
+        }
+    }
+    if (victim < 0) return false;
+    
+    // A fade already in progress is simply shortened; the ramp starts from the current gain
+    Voice& voice = voices_[victim];
+    voice.stolen = true;
+    voice.fadingOut = true;
+    stolenVoices_++;
+    voiceSteals_++;
+    VoiceSource* source = static_cast<VoiceSource*>(voice.source);
+    source->fadeRequest.store(msToFrames(kStealRampMs) + 1, std::memory_order_release);
+    return true;
+}
+
+uint32_t MiniaudioPlayer::msToFrames(int ms) const {
+    if (ms <= 0) return 0;
+    ma_uint32 sampleRate = ma_engine_get_sample_rate(static_cast<ma_engine*>(engine_));
+    return static_cast<uint32_t>(static_cast<uint64_t>(ms) * sampleRate / 1000);
 }
 
 void MiniaudioPlayer::playSound(const std::string& filepath, bool async) {
@@ -97,83 +757,185 @@ int MiniaudioPlayer::playSoundWithId(const std::string& filepath, bool async) {
     return playSoundWithIdAndVolume(filepath, 1.0f, async);
 }
 
-int MiniaudioPlayer::playSoundWithIdAndVolume(const std::string& filepath, float volume, bool async) {
+int MiniaudioPlayer::playSoundWithIdAndVolume(const std::string& filepath, float volume, bool async, int attackMs,
+                                              uint64_t inputTimestampUs, int voiceKey, SoundCategory category) {
     if (!engine_) return -1;
     
+    // Everything is played from decoded PCM once it's cached. Before that (the cache is still loading,
+    // or the file wasn't preloaded) the file is streamed instead of making the caller wait for a decode
+    bool failed = false;
+    SampleHandle sample = sampleCache_.find(filepath, &failed);
+    if (!sample) {
+        return failed ? -1 : streamSound(filepath, volume, category);
+    }
+    return playSample(sample, volume, async, attackMs, inputTimestampUs, voiceKey, category);
+}
+
+SampleHandle MiniaudioPlayer::getSample(const std::string& filepath) {
+    return sampleCache_.find(filepath);
+}
+
+// Fire-and-forget playback from disk: miniaudio's resource manager opens and decodes the file on its
+// job thread and the mixer reads it page by page, so this returns without touching the file. There is
+// no voice behind it, so no ID, fades or placement, and it can't be stolen. With loudness normalization on, a file whose level
+// isn't known yet (it has never been measured) is skipped rather than played at its raw level
+int MiniaudioPlayer::streamSound(const std::string& filepath, float volume, SoundCategory category) {
+    float gain = 1.0f;
+    if (!sampleCache_.streamGain(filepath, gain)) return -1;
+    
+    // Counted against the voice limit like any other sound, but a stream can't be stolen itself
+    std::lock_guard<std::mutex> lock(soundsMutex_);
+    cleanupFinishedSounds();
+    if (streams_.size() >= kMaxStreams ||
+        (playingSounds() >= maxConcurrentSounds_ && !stealVoice(-1))) {
+        voiceDrops_++;
+        return -1;
+    }
+    
+    ma_sound* sound = new ma_sound();
+    ma_uint32 flags = MA_SOUND_FLAG_STREAM | MA_SOUND_FLAG_ASYNC | MA_SOUND_FLAG_NO_PITCH | MA_SOUND_FLAG_NO_SPATIALIZATION;
+    ma_result result = ma_sound_init_from_file(static_cast<ma_engine*>(engine_), filepath.c_str(), flags, nullptr,
+                                               nullptr, sound);
+    if (result != MA_SUCCESS) {
+        std::cerr << "Failed to stream sound file: " << filepath << " (" << result << ")" << std::endl;
+        delete sound;
+        return -1;
+    }
+    
+    ma_splitter_node* bus = static_cast<ma_splitter_node*>(categoryBuses_[static_cast<int>(category)]);
+    if (bus) {
+        ma_node_attach_output_bus(sound, 0, bus, 0);
+    }
+    ma_sound_set_volume(sound, volume * masterVolume_.load(std::memory_order_relaxed) * gain);
+    streams_.push_back(sound); // Released by the next destroyStreams() if it fails to start
+    peakActiveVoices_ = std::max(peakActiveVoices_, playingSounds());
+    ma_sound_start(sound);
+    return 0;
+}
+
+// Done once it has played to the end, been stopped, or failed to start or to load its file in the
+// background. A stream in any of those states would otherwise hold its slot until shutdown
+static bool stream_done(ma_sound* sound) {
+    if (ma_sound_at_end(sound) || !ma_sound_is_playing(sound)) return true;
+    ma_result result = ma_resource_manager_data_source_result(sound->pResourceManagerDataSource);
+    return result != MA_SUCCESS && result != MA_BUSY;
+}
+
+void MiniaudioPlayer::destroyStreams(bool finishedOnly) {
+    for (size_t i = 0; i < streams_.size();) {
+        ma_sound* sound = static_cast<ma_sound*>(streams_[i]);
+        if (finishedOnly && !stream_done(sound)) {
+            i++;
+            continue;
+        }
+        ma_sound_uninit(sound);
+        delete sound;
+        streams_[i] = streams_.back();
+        streams_.pop_back();
+    }
+}
+
+int MiniaudioPlayer::playSample(const SampleHandle& sample, float volume, bool async, int attackMs,
+                                uint64_t inputTimestampUs, int voiceKey, SoundCategory category) {
+    if (!engine_ || !sample) return -1;
+    
+    uint64_t playUs = LatencyStats::nowUs();
+    if (playUs < inputTimestampUs || playUs - inputTimestampUs > kMaxInputLatencyUs) {
+        inputTimestampUs = 0;
+    }
+    if (inputTimestampUs != 0) {
+        latencyStats_.record(LatencyStats::INPUT_TO_PLAY, playUs - inputTimestampUs);
+    }
+    
     std::lock_guard<std::mutex> lock(soundsMutex_);
     cleanupFinishedSounds();
-    updateFadingSounds();
+    retireEffectsChains(false);
     
-    if (static_cast<int>(activeSounds_.size()) >= maxConcurrentSounds_) {
-        return -1; // Skip if at limit
+    // At the limit, make room by stealing a voice; skip the new sound if the policy won't
+    if (playingSounds() >= maxConcurrentSounds_ && !stealVoice(voiceKey)) {
+        voiceDrops_++;
+        return -1;
     }
     
     // Calculate final volume (individual * master)
-    float finalVolume = volume * masterVolume_;
+    float finalVolume = volume * masterVolume_.load(std::memory_order_relaxed) * sample->gain;
     
     if (async) {
-        ma_sound* sound = new ma_sound();
-        ma_result result = ma_sound_init_from_file(static_cast<ma_engine*>(engine_), 
-                                                   filepath.c_str(), 0, nullptr, nullptr, sound);
-        if (result == MA_SUCCESS) {
-            SoundInstance instance;
-            instance.sound = sound;
-            instance.id = nextSoundId_++;
-            instance.originalVolume = finalVolume;
-            
-            // Set the volume
-            ma_sound_set_volume(sound, finalVolume);
-            
-            // Apply spatial effects
-            applySpatialEffects(sound, instance);
-            
-            // Route sound through effects chain if available
-            if (effectsInitialized_) {
-                ma_node* soundNode = sound;
-                ma_node* endpoint = ma_engine_get_endpoint(static_cast<ma_engine*>(engine_));
-                
-                // Disconnect sound from default routing
-                ma_node_detach_output_bus(soundNode, 0);
-                
-                // Route through effects chain: sound -> reverb -> delay -> endpoint
-                ma_node* currentOutput = soundNode;
-                
-                if (reverbNode_) {
-                    ma_node_attach_output_bus(currentOutput, 0, static_cast<ma_reverb_node*>(reverbNode_), 0);
-                    currentOutput = static_cast<ma_reverb_node*>(reverbNode_);
-                }
-                
-                if (delayNode_) {
-                    ma_node_attach_output_bus(currentOutput, 0, static_cast<ma_delay_node*>(delayNode_), 0);
-                    currentOutput = static_cast<ma_delay_node*>(delayNode_);
-                }
-                
-                // Connect final output to endpoint
-                ma_node_attach_output_bus(currentOutput, 0, endpoint, 0);
-            }
-            
-            ma_sound_start(sound);
-            activeSounds_.push_back(instance);
-            
-            return instance.id;
-        } else {
-            delete sound;
+        int index = acquireVoice(category);
+        if (index < 0) {
+            voiceDrops_++; // Even the steal reserve is still ramping out
             return -1;
         }
+        
+        Voice& voice = voices_[index];
+        voice.sample = sample;
+        voice.fadingOut = false;
+        voice.startOrder = nextStartOrder_++;
+        voice.key = voiceKey;
+        voice.volume = finalVolume;
+        peakActiveVoices_ = std::max(peakActiveVoices_, playingSounds());
+        
+        // The voice is idle, so its source can be reset without racing the audio thread
+        VoiceSource* source = static_cast<VoiceSource*>(voice.source);
+        source->frames = sample->pcm;
+        source->frames16 = sample->pcm16;
+        source->frameCount = sample->frameCount;
+        source->cursor = 0;
+        source->endAfterRamp = false;
+        source->fadeRequest.store(0, std::memory_order_relaxed);
+        
+        // Optional attack: ramp in from silence instead of starting at full gain
+        uint32_t attackFrames = msToFrames(attackMs);
+        source->gainTarget = 1.0f;
+        source->rampFramesLeft = attackFrames;
+        source->gain = attackFrames > 0 ? 0.0f : 1.0f;
+        source->gainStep = attackFrames > 0 ? 1.0f / static_cast<float>(attackFrames) : 0.0f;
+        
+        ma_sound* sound = static_cast<ma_sound*>(voice.sound);
+        
+        // Set the volume
+        ma_sound_set_volume(sound, finalVolume);
+        
+        // Apply spatial effects
+        applySpatialEffects(sound, voice);
+        
+        source->inputUs = inputTimestampUs;
+        source->startUs = LatencyStats::nowUs();
+        source->rendered = false;
+        source->level.store(1.0f, std::memory_order_relaxed); // Counts as loud until it has played
+        source->trackLevel = stealPolicy_ == VoiceStealPolicy::QUIETEST;
+        latencyStats_.record(LatencyStats::PLAY_TO_START, source->startUs - playUs);
+        
+        ma_sound_start(sound);
+        
+        return static_cast<int>((voice.generation << kVoiceIndexBits) | static_cast<uint32_t>(index));
     } else {
         // Synchronous - don't track, just play and wait
+        ma_audio_buffer_ref buffer;
+        if (sample->pcm16) {
+            ma_audio_buffer_ref_init(ma_format_s16, sample->channels, sample->pcm16, sample->frameCount, &buffer);
+        } else {
+            ma_audio_buffer_ref_init(ma_format_f32, sample->channels, sample->pcm, sample->frameCount, &buffer);
+        }
+        
         ma_sound sound;
-        ma_result result = ma_sound_init_from_file(static_cast<ma_engine*>(engine_), 
-                                                   filepath.c_str(), 0, nullptr, nullptr, &sound);
+        ma_result result = ma_sound_init_from_data_source(static_cast<ma_engine*>(engine_), 
+                                                          &buffer, MA_SOUND_FLAG_NO_PITCH, nullptr, &sound);
         if (result == MA_SUCCESS) {
+            ma_splitter_node* bus = static_cast<ma_splitter_node*>(categoryBuses_[static_cast<int>(category)]);
+            if (bus) {
+                ma_node_attach_output_bus(&sound, 0, bus, 0);
+            }
             ma_sound_set_volume(&sound, finalVolume);
             ma_sound_start(&sound);
             while (ma_sound_is_playing(&sound)) {
-                ma_sleep(1);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
             ma_sound_uninit(&sound);
+            ma_audio_buffer_ref_uninit(&buffer);
             return 0; // Synchronous sounds don't need tracking
         }
+        ma_audio_buffer_ref_uninit(&buffer);
         return -1;
     }
 }
@@ -183,16 +945,13 @@ void MiniaudioPlayer::fadeOutSound(int soundId, int durationMs) {
     
     std::lock_guard<std::mutex> lock(soundsMutex_);
     
-    for (auto& instance : activeSounds_) {
-        if (instance.id == soundId && !instance.fadingOut) {
-            instance.fadingOut = true;
-            instance.fadeStartTime = getCurrentTimeMs();
-            instance.fadeDuration = durationMs;
-            
-            ma_sound* sound = static_cast<ma_sound*>(instance.sound);
-            instance.originalVolume = ma_sound_get_volume(sound);
-            break;
-        }
+    Voice* voice = findVoice(soundId);
+    if (voice && !voice->fadingOut) {
+        // The audio thread picks this up on its next callback and ramps from whatever gain
+        // the voice is at; the voice ends and is reclaimed when the ramp reaches zero
+        voice->fadingOut = true;
+        VoiceSource* source = static_cast<VoiceSource*>(voice->source);
+        source->fadeRequest.store(msToFrames(durationMs) + 1, std::memory_order_release);
     }
 }
 
@@ -201,188 +960,336 @@ void MiniaudioPlayer::stopSound(int soundId) {
     
     std::lock_guard<std::mutex> lock(soundsMutex_);
     
-    for (auto& instance : activeSounds_) {
-        if (instance.id == soundId) {
-            ma_sound* sound = static_cast<ma_sound*>(instance.sound);
-            ma_sound_stop(sound);
-            break;
-        }
+    // Ending through the source (instead of ma_sound_stop) keeps reclamation on the audio thread's
+    // end signal, and the few frames of ramp avoid a click
+    Voice* voice = findVoice(soundId);
+    if (voice) {
+        voice->fadingOut = true;
+        VoiceSource* source = static_cast<VoiceSource*>(voice->source);
+        source->fadeRequest.store(msToFrames(kStopRampMs) + 1, std::memory_order_release);
     }
 }
 
-void MiniaudioPlayer::update() {
-    if (!engine_) return;
-    
-    std::lock_guard<std::mutex> lock(soundsMutex_);
-    cleanupFinishedSounds();
-    updateFadingSounds();
-}
-
 void MiniaudioPlayer::setAudioEffects(const AudioEffectsConfig& effects) {
-    effectsConfig_ = const_cast<AudioEffectsConfig*>(&effects);
+    std::lock_guard<std::mutex> lock(soundsMutex_);
+    *effectsConfig_ = effects;
+    if (keyLayout_->layout() != effects.keyboardLayout) {
+        keyLayout_->build(effects.keyboardLayout);
+    }
+    if (!engine_ || !effectsInput_) return;
     
-    // Always cleanup and reinitialize effects chain to handle config changes
-    cleanupEffectsChain();
+    applyEffectSends();
+    retireEffectsChains(false);
     
-    // Initialize effects chain if any effects are enabled
-    if (effects.enableEcho || effects.enableReverb) {
-        if (initializeEffectsChain()) {
-            std::cout << "Audio effects applied successfully" << std::endl;
+    // Same set of effects: change parameters in place, which keeps the reverb and echo tails going
+    if (activeChain_ && effectsChainMatches(*activeChain_, effects)) {
+        applyEffectParams(*activeChain_);
+        if (activeChain_->reverb || activeChain_->echo) {
+            std::cout << "Audio effects updated" << std::endl;
         } else {
-            std::cerr << "Failed to initialize audio effects" << std::endl;
+            std::cout << "Audio effects disabled" << std::endl;
+        }
+        return;
+    }
+    
+    // Otherwise build the new chain next to the old one and crossfade. Voices never move, so
+    // nothing is ever detached from a node that is still being read
+    ma_uint32 bus = kEffectsChainSlots;
+    while (bus == kEffectsChainSlots) {
+        for (ma_uint32 candidate = 0; candidate < kEffectsChainSlots; candidate++) {
+            bool used = activeChain_ && activeChain_->inputBus == candidate;
+            for (EffectsChain* retiring : retiringChains_) {
+                used = used || retiring->inputBus == candidate;
+            }
+            if (!used) {
+                bus = candidate;
+                break;
+            }
+        }
+        if (bus == kEffectsChainSlots) {
+            // Every output is still fading, cut the oldest one short
+            destroyEffectsChain(retiringChains_.front());
+            retiringChains_.erase(retiringChains_.begin());
         }
+    }
+    
+    EffectsChain* chain = createEffectsChain(effects, bus);
+    if (!chain) {
+        std::cerr << "Failed to initialize audio effects" << std::endl;
+        return;
+    }
+    
+    if (activeChain_) {
+        ma_engine* engine = static_cast<ma_engine*>(engine_);
+        ma_sound_group_set_fade_in_milliseconds(&activeChain_->output, -1.0f, 0.0f, kEffectsCrossfadeMs);
+        activeChain_->retireAtFrame = ma_engine_get_time_in_pcm_frames(engine) + msToFrames(kEffectsCrossfadeMs * 2);
+        retiringChains_.push_back(activeChain_);
+    }
+    activeChain_ = chain;
+    
+    if (chain->reverb || chain->echo) {
+        std::cout << "Effects chain established: sounds -> ";
+        if (chain->reverb) std::cout << "reverb -> ";
+        if (chain->echo) std::cout << "delay -> ";
+        std::cout << "output" << std::endl;
+        std::cout << "Audio effects applied successfully" << std::endl;
     } else {
         std::cout << "Audio effects disabled" << std::endl;
     }
 }
 
-bool MiniaudioPlayer::initializeEffectsChain() {
-    if (!engine_ || effectsInitialized_) return effectsInitialized_;
+bool MiniaudioPlayer::createEffectsInput() {
+    ma_engine* engine = static_cast<ma_engine*>(engine_);
     
+    ma_splitter_node_config splitterConfig = ma_splitter_node_config_init(ma_engine_get_channels(engine));
+    splitterConfig.outputBusCount = kEffectsChainSlots;
+    
+    ma_splitter_node* splitter = new ma_splitter_node();
+    if (ma_splitter_node_init(ma_engine_get_node_graph(engine), &splitterConfig, nullptr, splitter) != MA_SUCCESS) {
+        delete splitter;
+        return false;
+    }
+    effectsInput_ = splitter;
+    return true;
+}
+
+bool MiniaudioPlayer::createCategoryBuses() {
+    ma_engine* engine = static_cast<ma_engine*>(engine_);
+    
+    // A splitter sums everything attached to its input, so it doubles as the category's submix
+    ma_splitter_node_config splitterConfig = ma_splitter_node_config_init(ma_engine_get_channels(engine));
+    splitterConfig.outputBusCount = 2;
+    
+    for (int category = 0; category < kSoundCategoryCount; category++) {
+        ma_splitter_node* splitter = new ma_splitter_node();
+        if (ma_splitter_node_init(ma_engine_get_node_graph(engine), &splitterConfig, nullptr, splitter) != MA_SUCCESS) {
+            delete splitter;
+            return false;
+        }
+        ma_node_attach_output_bus(splitter, 0, ma_engine_get_endpoint(engine), 0);
+        if (effectsInput_) {
+            ma_node_attach_output_bus(splitter, 1, static_cast<ma_splitter_node*>(effectsInput_), 0);
+        }
+        categoryBuses_[category] = splitter;
+    }
+    return true;
+}
+
+void MiniaudioPlayer::applyEffectSends() {
+    const EffectSends* sends[kSoundCategoryCount] = {&effectsConfig_->keyboardSends, &effectsConfig_->mouseSends};
+    
+    for (int category = 0; category < kSoundCategoryCount; category++) {
+        ma_splitter_node* bus = static_cast<ma_splitter_node*>(categoryBuses_[category]);
+        if (!bus) continue;
+        ma_node_set_output_bus_volume(bus, 0, std::max(0.0f, sends[category]->dry));
+        ma_node_set_output_bus_volume(bus, 1, std::max(0.0f, sends[category]->wet));
+    }
+}
+
+static EchoLayout echo_layout(const AudioEffectsConfig& effects, ma_uint32 sampleRate) {
+    EchoLayout layout;
+    for (const EchoTapConfig& tap : effects.echoTapList) {
+        EchoTap frames;
+        frames.delayFrames = std::max<ma_uint32>(1, static_cast<ma_uint32>(tap.delay * sampleRate));
+        frames.gain = tap.gain;
+        layout.taps.push_back(frames);
+    }
+    if (layout.taps.empty()) {
+        layout.spacingFrames = std::max<ma_uint32>(1, static_cast<ma_uint32>(effects.echoDelay * sampleRate));
+        layout.tapCount = static_cast<ma_uint32>(std::max(1, effects.echoTaps));
+    }
+    return layout;
+}
+
+bool MiniaudioPlayer::effectsChainMatches(const EffectsChain& chain, const AudioEffectsConfig& effects) const {
+    if ((chain.reverb != nullptr) != effects.enableReverb) return false;
+    if ((chain.echo != nullptr) != effects.enableEcho) return false;
+    
+    // The echo's delay line is sized for its taps, so moving or adding taps needs a new node
+    ma_uint32 sampleRate = ma_engine_get_sample_rate(static_cast<ma_engine*>(engine_));
+    return !effects.enableEcho || chain.echoLayout == echo_layout(effects, sampleRate);
+}
+
+// Translates the config into node parameters
+static ReverbParams reverb_params(const AudioEffectsConfig& effects) {
+    // Compensate for verblib's internal scaling (wet=3x, dry=2x) so 0.5 wetness sounds balanced
+    ReverbParams params;
+    params.wet = effects.reverbWetness * (2.0f / 3.0f);
+    params.dry = 1.0f - effects.reverbWetness;
+    params.roomSize = effects.reverbRoomSize;
+    params.damping = effects.reverbDamping;
+    params.width = effects.reverbWidth;
+    return params;
+}
+
+static EchoParams echo_params(const AudioEffectsConfig& effects) {
+    EchoParams params;
+    params.decay = effects.echoDecay;
+    params.feedback = effects.echoFeedback;
+    params.damping = effects.echoDamping;
+    return params;
+}
+
+EffectsChain* MiniaudioPlayer::createEffectsChain(const AudioEffectsConfig& effects, uint32_t bus) {
     ma_engine* engine = static_cast<ma_engine*>(engine_);
     ma_node_graph* nodeGraph = ma_engine_get_node_graph(engine);
-    ma_node* endpoint = ma_engine_get_endpoint(engine);
+    ma_uint32 channels = ma_engine_get_channels(engine);
+    ma_uint32 sampleRate = ma_engine_get_sample_rate(engine);
     
-    // Clean up any existing effects first
-    cleanupEffectsChain();
+    EffectsChain* chain = new EffectsChain();
+    chain->inputBus = bus;
     
-    ma_node* currentInput = endpoint;  // Start from the endpoint and work backwards
+    // The output group attaches itself to the endpoint
+    if (ma_sound_group_init(engine, MA_SOUND_FLAG_NO_PITCH, nullptr, &chain->output) != MA_SUCCESS) {
+        delete chain;
+        return nullptr;
+    }
+    chain->outputInitialized = true;
+    ma_node* next = &chain->output;
     
-    // Initialize delay node for echo effects (last in chain, closest to output)
-    if (effectsConfig_ && effectsConfig_->enableEcho) {
-        delayNode_ = new ma_delay_node();
-        ma_delay_node* delay = static_cast<ma_delay_node*>(delayNode_);
-        
-        ma_delay_node_config delayConfig = ma_delay_node_config_init(
-            ma_engine_get_channels(engine),
-            ma_engine_get_sample_rate(engine),
-            (ma_uint32)(effectsConfig_->echoDelay * ma_engine_get_sample_rate(engine)), // delay in samples
-            effectsConfig_->echoDecay
-        );
-        
-        ma_result result = ma_delay_node_init(nodeGraph, &delayConfig, nullptr, delay);
+    // Built from the output backwards: echo is last, closest to the output
+    if (effects.enableEcho) {
+        chain->echo = new EchoNode();
+        chain->echoLayout = echo_layout(effects, sampleRate);
+        ma_result result = chain->echo->init(nodeGraph, channels, sampleRate, chain->echoLayout, echo_params(effects));
         if (result != MA_SUCCESS) {
             std::cerr << "Failed to initialize delay node: " << result << std::endl;
-            delete delay;
-            delayNode_ = nullptr;
-            return false;
+            destroyEffectsChain(chain);
+            return nullptr;
         }
-        
-        // Connect delay output to the current input (endpoint or next effect)
-        ma_node_attach_output_bus(delay, 0, currentInput, 0);
-        currentInput = delay;  // Now delay becomes the input for the next effect
-        
-        std::cout << "Echo effect initialized successfully" << std::endl;
+        ma_node_attach_output_bus(chain->echo->node(), 0, next, 0);
+        next = chain->echo->node();
     }
     
-    // Initialize reverb node (first in chain, closest to input)
-    if (effectsConfig_ && effectsConfig_->enableReverb) {
-        reverbNode_ = new ma_reverb_node();
-        ma_reverb_node* reverb = static_cast<ma_reverb_node*>(reverbNode_);
-        
-        ma_reverb_node_config reverbConfig = ma_reverb_node_config_init(
-            ma_engine_get_channels(engine),
-            ma_engine_get_sample_rate(engine)
-        );
-        
-        // Configure reverb parameters based on the actual verblib API
-        // Compensate for verblib's internal scaling (wet=3x, dry=2x)
-        float wetness = effectsConfig_->reverbWetness;
-        float wetLevel = wetness * (2.0f / 3.0f);  // Compensate for stronger wet scaling
-        float dryLevel = 1.0f - wetness;           // Keep dry proportional to wetness
-        
-        reverbConfig.roomSize = effectsConfig_->reverbRoomSize;     // 0.0 to 1.0
-        reverbConfig.damping = effectsConfig_->reverbDamping;       // 0.0 to 1.0
-        reverbConfig.wetVolume = wetLevel;                          // Balanced wet signal level
-        reverbConfig.dryVolume = dryLevel;                          // Balanced dry signal level
-        reverbConfig.width = effectsConfig_->reverbWidth;           // Stereo width
-        reverbConfig.mode = 0.0f;                                   // Normal mode (not frozen)
-        
-        ma_result result = ma_reverb_node_init(nodeGraph, &reverbConfig, nullptr, reverb);
+    if (effects.enableReverb) {
+        chain->reverb = new ReverbNode();
+        ma_result result = chain->reverb->init(nodeGraph, channels, sampleRate, reverb_params(effects));
         if (result != MA_SUCCESS) {
             std::cerr << "Failed to initialize reverb node: " << result << std::endl;
-            delete reverb;
-            reverbNode_ = nullptr;
-            return false;
+            destroyEffectsChain(chain);
+            return nullptr;
         }
-        
-        // Connect reverb output to the current input (delay or endpoint)
-        ma_node_attach_output_bus(reverb, 0, currentInput, 0);
-        currentInput = reverb;  // Now reverb becomes the input for sounds
-        
-        std::cout << "Reverb effect initialized successfully" << std::endl;
+        ma_node_attach_output_bus(chain->reverb->node(), 0, next, 0);
+        next = chain->reverb->node();
     }
     
-    // The effects chain is now set up and ready
-    // Individual sounds will be routed through it in playSoundWithId
-    if (currentInput != endpoint) {
-        std::cout << "Effects chain established: sounds -> ";
-        if (reverbNode_) std::cout << "reverb -> ";
-        if (delayNode_) std::cout << "delay -> ";
-        std::cout << "output" << std::endl;
+    // The very first chain starts at full volume, later ones fade in against the outgoing chain
+    if (activeChain_) {
+        ma_sound_group_set_fade_in_milliseconds(&chain->output, 0.0f, 1.0f, kEffectsCrossfadeMs);
     }
     
-    effectsInitialized_ = true;
-    return true;
+    ma_node_attach_output_bus(static_cast<ma_splitter_node*>(effectsInput_), bus, next, 0);
+    return chain;
+}
+
+void MiniaudioPlayer::applyEffectParams(EffectsChain& chain) {
+    if (chain.reverb) chain.reverb->setParams(reverb_params(*effectsConfig_));
+    if (chain.echo) chain.echo->setParams(echo_params(*effectsConfig_));
 }
 
-void MiniaudioPlayer::cleanupEffectsChain() {
-    if (delayNode_) {
-        ma_delay_node_uninit(static_cast<ma_delay_node*>(delayNode_), nullptr);
-        delete static_cast<ma_delay_node*>(delayNode_);
-        delayNode_ = nullptr;
+void MiniaudioPlayer::destroyEffectsChain(EffectsChain* chain) {
+    // Cut it off at the source first, then tear down from upstream to downstream
+    if (effectsInput_) {
+        ma_node_detach_output_bus(static_cast<ma_splitter_node*>(effectsInput_), chain->inputBus);
     }
     
-    if (reverbNode_) {
-        ma_reverb_node_uninit(static_cast<ma_reverb_node*>(reverbNode_), nullptr);
-        delete static_cast<ma_reverb_node*>(reverbNode_);
-        reverbNode_ = nullptr;
+    delete chain->reverb;
+    delete chain->echo;
+    if (chain->outputInitialized) {
+        ma_sound_group_uninit(&chain->output);
     }
-    
-    effectsInitialized_ = false;
+    delete chain;
 }
 
-void MiniaudioPlayer::updateReverbSettings() {
-    if (!reverbNode_ || !effectsConfig_) return;
-    
-    ma_reverb_node* reverb = static_cast<ma_reverb_node*>(reverbNode_);
-    verblib* verb = &reverb->reverb;
+void MiniaudioPlayer::retireEffectsChains(bool force) {
+    if (retiringChains_.empty()) return;
     
-    // Compensate for verblib's internal scaling:
-    // verblib_scalewet = 3.0f, verblib_scaledry = 2.0f
-    // To get equal loudness at 0.5 wetness, we need to account for this difference
-    float wetness = effectsConfig_->reverbWetness;
-    float dryness = 1.0f - wetness;
+    ma_uint64 now = ma_engine_get_time_in_pcm_frames(static_cast<ma_engine*>(engine_));
+    for (size_t i = 0; i < retiringChains_.size();) {
+        if (force || now >= retiringChains_[i]->retireAtFrame) {
+            destroyEffectsChain(retiringChains_[i]);
+            retiringChains_.erase(retiringChains_.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void MiniaudioPlayer::destroyEffects() {
+    for (void*& bus : categoryBuses_) {
+        if (bus) {
+            ma_splitter_node_uninit(static_cast<ma_splitter_node*>(bus), nullptr);
+            delete static_cast<ma_splitter_node*>(bus);
+            bus = nullptr;
+        }
+    }
     
-    // Scale compensation: wet gets 3x boost, dry gets 2x boost
-    // To balance them, we need wet_actual * 3.0 ≈ dry_actual * 2.0
-    // So wet_actual = dry_actual * (2.0/3.0) = dry_actual * 0.667
-    float wetLevel = wetness * (2.0f / 3.0f);  // Compensate for stronger wet scaling
-    float dryLevel = dryness;                  // Keep dry as-is
+    retireEffectsChains(true);
+    if (activeChain_) {
+        destroyEffectsChain(activeChain_);
+        activeChain_ = nullptr;
+    }
     
-    // Update verblib parameters directly
-    verblib_set_room_size(verb, effectsConfig_->reverbRoomSize);
-    verblib_set_damping(verb, effectsConfig_->reverbDamping);
-    verblib_set_wet(verb, wetLevel);
-    verblib_set_dry(verb, dryLevel);
-    verblib_set_width(verb, 1.0f); // Keep stereo width at 1.0
+    if (effectsInput_) {
+        ma_splitter_node_uninit(static_cast<ma_splitter_node*>(effectsInput_), nullptr);
+        delete static_cast<ma_splitter_node*>(effectsInput_);
+        effectsInput_ = nullptr;
+    }
 }
 
-void MiniaudioPlayer::applySpatialEffects(void* sound, SoundInstance& instance) {
-    if (!effectsConfig_ || !effectsConfig_->enableSpatializer) return;
-    
+void MiniaudioPlayer::applySpatialEffects(void* sound, Voice& voice) {
     ma_sound* maSound = static_cast<ma_sound*>(sound);
+    VoiceSource* source = static_cast<VoiceSource*>(voice.source);
+    
+    // Voices are reused, so start from what a sound with no placement has. A sound at the listener
+    // comes out of the spatializer unchanged, so the spatializer is only run for 3D placement
+    voice.spatialX = voice.spatialY = voice.spatialZ = 0.0f;
+    source->panned = false;
+    source->panLeft = source->panRight = 1.0f;
+    ma_sound_set_position(maSound, 0.0f, 0.0f, 0.0f);
+    ma_sound_set_spatialization_enabled(maSound, MA_FALSE);
+    if (!effectsConfig_->enableSpatializer) return;
+    
+    // With a keyboard layout, keyboard sounds come from where their key is: across the field from
+    // left to right and further away towards the function keys
+    const KeyPosition& key = keyLayout_->position(voice.category == SoundCategory::KEYBOARD ? voice.key : -1);
     
-    if (effectsConfig_->randomSpatialPosition) {
+    if (effectsConfig_->spatialMode == SpatialMode::PAN) {
+        if (source->channels != 2) return; // Only defined for a stereo output
+        
+        // Same horizontal placement as 3D: the pan is the sine of the angle to a point
+        // listener_distance in front of the listener and up to spatial_spread to the side
+        if (key.known) {
+            voice.spatialX = key.x * effectsConfig_->spatialSpread;
+        } else if (effectsConfig_->randomSpatialPosition) {
+            std::uniform_real_distribution<float> dist(-effectsConfig_->spatialSpread, effectsConfig_->spatialSpread);
+            voice.spatialX = dist(spatialRng_);
+        }
+        float distance = std::max(effectsConfig_->listenerDistance, 0.001f);
+        float pan = voice.spatialX / std::sqrt(voice.spatialX * voice.spatialX + distance * distance);
+        
+        // Constant power: left^2 + right^2 stays 2, so a centred sound is left untouched and the
+        // stereo samples keep their loudness wherever they are placed
+        float angle = (pan + 1.0f) * 0.25f * kPi;
+        source->panned = true;
+        source->panLeft = std::sqrt(2.0f) * std::cos(angle);
+        source->panRight = std::sqrt(2.0f) * std::sin(angle);
+        return;
+    }
+    
+    if (key.known) {
+        voice.spatialX = key.x * effectsConfig_->spatialSpread;
+        voice.spatialZ = effectsConfig_->listenerDistance + (key.depth - 0.5f) * effectsConfig_->spatialSpread;
+    } else if (effectsConfig_->randomSpatialPosition) {
         // Generate random 3D position within the spatial field
         std::uniform_real_distribution<float> dist(-effectsConfig_->spatialSpread, effectsConfig_->spatialSpread);
-        instance.spatialX = dist(spatialRng_);
-        instance.spatialY = dist(spatialRng_) * 0.5f; // Less vertical spread
-        instance.spatialZ = effectsConfig_->listenerDistance + dist(spatialRng_) * 0.5f;
+        voice.spatialX = dist(spatialRng_);
+        voice.spatialY = dist(spatialRng_) * 0.5f; // Less vertical spread
+        voice.spatialZ = effectsConfig_->listenerDistance + dist(spatialRng_) * 0.5f;
     }
     
     // Apply 3D positioning
-    ma_sound_set_position(maSound, instance.spatialX, instance.spatialY, instance.spatialZ);
+    ma_sound_set_position(maSound, voice.spatialX, voice.spatialY, voice.spatialZ);
     ma_sound_set_spatialization_enabled(maSound, MA_TRUE);
 }
 
@@ -390,22 +1297,20 @@ void MiniaudioPlayer::cleanup() {
     if (engine_) {
         std::lock_guard<std::mutex> lock(soundsMutex_);
         
-        // Stop and cleanup all active sounds
-        for (const auto& instance : activeSounds_) {
-            ma_sound* sound = static_cast<ma_sound*>(instance.sound);
-            ma_sound_uninit(sound);
-            delete sound;
-        }
-        activeSounds_.clear();
+        // Stop and cleanup all voices
+        destroyVoices();
+        destroyStreams(false);
         
-        // Cleanup effects chain
-        cleanupEffectsChain();
+        // The voices are gone, so the effects can go without anything still feeding them
+        destroyEffects();
         
-        // Cleanup engine
+        // Cleanup engine. It stops our device first, which is then closed
         ma_engine_uninit(static_cast<ma_engine*>(engine_));
         delete static_cast<ma_engine*>(engine_);
         engine_ = nullptr;
     }
+    
+    closeDevice();
 }
 
 MiniaudioPlayer::~MiniaudioPlayer() {
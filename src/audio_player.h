@@ -2,37 +2,111 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <functional>
 #include <mutex>
+#include <atomic>
 #include <random>
+#include <cstdint>
+#include "sample_cache.h"
+#include "latency_stats.h"
+#include "spsc_queue.h"
 
-// Forward declaration
+// Forward declarations
 struct AudioEffectsConfig;
+struct AudioLatencyConfig;
+struct SampleLoadConfig;
+enum class VoiceStealPolicy;
+struct EffectsChain;
+class KeyLayout;
+
+// Where a sound comes from. Each category has its own submix with separate dry and wet effect sends
+enum class SoundCategory { KEYBOARD, MOUSE };
+constexpr int kSoundCategoryCount = 2;
+
+struct VoiceStats {
+    int active = 0;       // Voices and streams, as counted against the limit
+    int peakActive = 0;   // High-water mark since startup
+    uint64_t steals = 0;  // Voices cut short to make room for a new sound
+    uint64_t drops = 0;   // New sounds skipped because nothing could be stolen
+};
 
 class AudioPlayer {
 public:
     static std::unique_ptr<AudioPlayer> create();
     virtual ~AudioPlayer() = default;
     
-    virtual bool initialize() = 0;
+    virtual bool initialize(const AudioLatencyConfig& latency) = 0;
     virtual void playSound(const std::string& filepath, bool async = true) = 0;
     virtual int playSoundWithId(const std::string& filepath, bool async = true) = 0;
-    virtual int playSoundWithIdAndVolume(const std::string& filepath, float volume, bool async = true) = 0;
+    // inputTimestampUs is when the triggering input arrived (LatencyStats::nowUs() clock), 0 if not from live input.
+    // voiceKey identifies the key or button behind the sound for same-key voice stealing, -1 for none
+    virtual int playSoundWithIdAndVolume(const std::string& filepath, float volume, bool async = true, int attackMs = 0,
+                                         uint64_t inputTimestampUs = 0, int voiceKey = -1,
+                                         SoundCategory category = SoundCategory::KEYBOARD) = 0;
+    // Resolves a file to its cached sample once, so hot paths can play it without looking up the path.
+    // Null if the file can't be decoded or isn't loaded yet
+    virtual SampleHandle getSample(const std::string& filepath) = 0;
+    virtual int playSample(const SampleHandle& sample, float volume, bool async = true, int attackMs = 0,
+                           uint64_t inputTimestampUs = 0, int voiceKey = -1,
+                           SoundCategory category = SoundCategory::KEYBOARD) = 0;
     virtual void fadeOutSound(int soundId, int durationMs) = 0;
     virtual void stopSound(int soundId) = 0;
-    virtual void update() = 0; // Regular update for fade processing
     virtual void cleanup() = 0;
     virtual void setMaxConcurrentSounds(int maxSounds) = 0;
+    virtual void setVoiceStealPolicy(VoiceStealPolicy policy) = 0;
     virtual void setAudioEffects(const AudioEffectsConfig& effects) = 0;
     virtual void setMasterVolume(float volume) = 0;
+    virtual void preloadSounds(const std::vector<std::string>& filepaths) = 0; // Decode into the sample cache
+    // Same, but decodes on background threads and returns right away. Until onReady runs (on a loader
+    // thread), files that aren't cached yet are streamed from disk when played by path. With loudness
+    // normalization on, only files whose level is already known (from the pack or the loudness cache) stream
+    virtual void preloadSoundsAsync(const std::vector<std::string>& filepaths, std::function<void()> onReady = nullptr) = 0;
+    // Map a sound pack and play the samples it has from there, empty path for none. Call before preloadSounds.
+    // True if that dropped the cached samples, so they have to be preloaded again
+    virtual bool setSoundPack(const std::string& path) = 0;
+    // Silence trimming, storage format and loudness normalization for samples loaded from here on.
+    // Call before preloadSounds. True if that dropped the cached samples
+    virtual bool setSampleLoading(const SampleLoadConfig& config) = 0;
+    // Drop these files from the sample cache, e.g. because they changed on disk. The next preload
+    // decodes them again; until then they stream
+    virtual void forgetSounds(const std::vector<std::string>& filepaths) = 0;
+    virtual SampleCacheStats getCacheStats() const = 0;
+    virtual const LatencyStats& getLatencyStats() const = 0;
+    virtual VoiceStats getVoiceStats() = 0;
+    
+    // Offline rendering: no device is opened and the mix only advances when renderFrames() is called
+    virtual bool initializeOffline(uint32_t channels, uint32_t sampleRate) = 0;
+    virtual uint64_t renderFrames(float* output, uint64_t frameCount) = 0; // Interleaved f32
+    virtual uint32_t getChannels() const = 0;
+    virtual uint32_t getSampleRate() const = 0;
+    virtual void setRandomSeed(uint32_t seed) = 0; // Makes spatial placement reproducible
 };
 
-struct SoundInstance {
-    void* sound; // ma_sound*
-    int id;
+// Sound IDs handed out by the player are voice handles: the low bits index the voice pool and the
+// high bits carry the voice's generation, so a handle kept past the end of its sound never matches
+// whatever plays in that voice next
+constexpr int kVoiceIndexBits = 12;
+constexpr int kMaxVoices = 1 << kVoiceIndexBits;
+constexpr uint32_t kVoiceGenerationMask = 0x7FFFF; // Keeps handles positive
+
+// Extra voices beyond max_concurrent_sounds so a stolen voice can ramp out while its replacement starts
+constexpr int kStealReserveVoices = 8;
+
+// A preallocated playback slot. Its ma_sound is created once, wired to its category's submix, and
+// re-pointed at cached PCM on every play
+struct Voice {
+    void* sound = nullptr; // ma_sound*
+    void* source = nullptr; // VoiceSource*, reads the cached PCM and applies fades on the audio thread
+    std::shared_ptr<const CachedSample> sample; // Keeps the PCM alive while the sound plays
+    uint32_t generation = 1;
+    int nextFree = -1; // Free list link while idle
+    int activeSlot = -1; // Position in activeVoices_ while playing
     bool fadingOut = false;
-    float originalVolume = 1.0f;
-    int fadeStartTime = 0;
-    int fadeDuration = 0;
+    bool stolen = false; // Ramping out to make room, no longer counts against the limit
+    uint64_t startOrder = 0;
+    int key = -1; // voiceKey passed to play
+    SoundCategory category = SoundCategory::KEYBOARD; // Fixed at allocation
+    float volume = 1.0f;
     float spatialX = 0.0f;
     float spatialY = 0.0f;
     float spatialZ = 0.0f;
@@ -40,38 +114,92 @@ struct SoundInstance {
 
 class MiniaudioPlayer : public AudioPlayer {
 private:
-    void* engine_; // ma_engine*
-    void* delayNode_; // ma_delay_node*
-    void* reverbNode_; // ma_reverb_node*
-    std::vector<SoundInstance> activeSounds_;
+    void* engine_ = nullptr; // ma_engine*
+    void* context_ = nullptr; // ma_context*, owned when we open the device ourselves
+    void* device_ = nullptr; // ma_device*
+    void* effectsInput_ = nullptr; // ma_splitter_node*, the wet sends of every category feed this
+    void* categoryBuses_[kSoundCategoryCount] = {}; // ma_splitter_node*, output 0 is the dry send, 1 the wet send
+    EffectsChain* activeChain_ = nullptr;
+    std::vector<EffectsChain*> retiringChains_; // Fading out after being replaced
+    std::vector<Voice> voices_; // Allocated in initialize(), one pool per category, only grows when the limit is raised
+    std::vector<int> activeVoices_; // Indices of playing voices, compacted by swapping with the last
+    int freeVoices_[kSoundCategoryCount] = {-1, -1}; // Head of each category's free list
+    SpscQueue<int, kMaxVoices> finishedVoices_; // Pushed by the audio thread when a voice ends
     std::mutex soundsMutex_;
     int maxConcurrentSounds_ = 32;
-    int nextSoundId_ = 1;
-    AudioEffectsConfig* effectsConfig_ = nullptr;
+    VoiceStealPolicy stealPolicy_;
+    int stolenVoices_ = 0; // Active voices that are ramping out after being stolen
+    uint64_t nextStartOrder_ = 0;
+    int peakActiveVoices_ = 0;
+    uint64_t voiceSteals_ = 0;
+    uint64_t voiceDrops_ = 0;
+    std::unique_ptr<AudioEffectsConfig> effectsConfig_; // Copy of the last config applied
     std::mt19937 spatialRng_;
-    bool effectsInitialized_ = false;
-    float masterVolume_ = 1.0f;
+    std::unique_ptr<KeyLayout> keyLayout_; // Rebuilt when keyboard_layout changes
+    std::atomic<float> masterVolume_{1.0f}; // Set from the config watcher thread while sounds start
+    SampleCache sampleCache_;
+    std::string soundPackPath_;
+    int64_t soundPackModified_ = 0; // Write time of the pack when it was mapped, to remap a rebuilt one
+    LatencyStats latencyStats_;
+    std::vector<void*> streams_; // ma_sound*, files played straight from disk while the cache is loading
     
+    bool initializeEngine(const void* engineConfig); // ma_engine_config*
+    bool openDevice(const AudioLatencyConfig& latency);
+    void closeDevice();
+    bool allocateVoices(SoundCategory category, int count);
+    void destroyVoices();
+    int acquireVoice(SoundCategory category);
+    void releaseVoice(int index);
+    Voice* findVoice(int soundId);
     void cleanupFinishedSounds();
-    void updateFadingSounds();
-    int getCurrentTimeMs();
-    void applySpatialEffects(void* sound, SoundInstance& instance);
-    bool initializeEffectsChain();
-    void cleanupEffectsChain();
-    void updateReverbSettings();
+    int playingSounds() const;
+    int streamSound(const std::string& filepath, float volume, SoundCategory category);
+    void destroyStreams(bool finishedOnly);
+    void printCacheSummary(int failed);
+    bool stealVoice(int key);
+    uint32_t msToFrames(int ms) const;
+    void applySpatialEffects(void* sound, Voice& voice);
+    bool createEffectsInput();
+    bool createCategoryBuses();
+    void applyEffectSends();
+    EffectsChain* createEffectsChain(const AudioEffectsConfig& effects, uint32_t bus);
+    bool effectsChainMatches(const EffectsChain& chain, const AudioEffectsConfig& effects) const;
+    void applyEffectParams(EffectsChain& chain);
+    void destroyEffectsChain(EffectsChain* chain);
+    void retireEffectsChains(bool force);
+    void destroyEffects();
     
 public:
-    MiniaudioPlayer() : spatialRng_(std::random_device{}()) {}
-    bool initialize() override;
+    MiniaudioPlayer();
+    bool initialize(const AudioLatencyConfig& latency) override;
     void playSound(const std::string& filepath, bool async = true) override;
     int playSoundWithId(const std::string& filepath, bool async = true) override;
-    int playSoundWithIdAndVolume(const std::string& filepath, float volume, bool async = true) override;
+    int playSoundWithIdAndVolume(const std::string& filepath, float volume, bool async = true, int attackMs = 0,
+                                 uint64_t inputTimestampUs = 0, int voiceKey = -1,
+                                 SoundCategory category = SoundCategory::KEYBOARD) override;
+    SampleHandle getSample(const std::string& filepath) override;
+    int playSample(const SampleHandle& sample, float volume, bool async = true, int attackMs = 0,
+                   uint64_t inputTimestampUs = 0, int voiceKey = -1,
+                   SoundCategory category = SoundCategory::KEYBOARD) override;
     void fadeOutSound(int soundId, int durationMs) override;
     void stopSound(int soundId) override;
-    void update() override;
     void cleanup() override;
     void setMaxConcurrentSounds(int maxSounds) override;
+    void setVoiceStealPolicy(VoiceStealPolicy policy) override;
     void setAudioEffects(const AudioEffectsConfig& effects) override;
     void setMasterVolume(float volume) override;
+    void preloadSounds(const std::vector<std::string>& filepaths) override;
+    void preloadSoundsAsync(const std::vector<std::string>& filepaths, std::function<void()> onReady = nullptr) override;
+    bool setSoundPack(const std::string& path) override;
+    bool setSampleLoading(const SampleLoadConfig& config) override;
+    void forgetSounds(const std::vector<std::string>& filepaths) override;
+    SampleCacheStats getCacheStats() const override;
+    const LatencyStats& getLatencyStats() const override;
+    VoiceStats getVoiceStats() override;
+    bool initializeOffline(uint32_t channels, uint32_t sampleRate) override;
+    uint64_t renderFrames(float* output, uint64_t frameCount) override;
+    uint32_t getChannels() const override;
+    uint32_t getSampleRate() const override;
+    void setRandomSeed(uint32_t seed) override;
     ~MiniaudioPlayer();
 };
@@ -0,0 +1,547 @@
+#include "benchmarks.h"
+#include "audio_player.h"
+#include "config.h"
+#include "effect_nodes.h"
+#include "reverb_kernel.h"
+#include "key_state.h"
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+const ma_uint32 kBenchChannels = 2;
+const ma_uint32 kBenchSampleRate = 48000;
+const ma_uint32 kBenchBlockFrames = 480; // Same pass size a 10 ms device period gives the engine
+
+struct IdleRun {
+    double cpuSeconds = 0.0;
+    double idleAfterMs = -1.0; // When the reverb went idle, -1 if it never did
+};
+
+// One click-sized noise burst through the reverb, then a long stretch of silence, which is what the
+// reverb sees most of the time between keystrokes
+IdleRun run_reverb_idle(bool idleBypass, double seconds) {
+    IdleRun run;
+    
+    ma_node_graph_config graphConfig = ma_node_graph_config_init(kBenchChannels);
+    ma_node_graph graph;
+    if (ma_node_graph_init(&graphConfig, nullptr, &graph) != MA_SUCCESS) return run;
+    
+    std::vector<float> burst(kBenchSampleRate / 20 * kBenchChannels);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    for (float& sample : burst) {
+        sample = noise(rng);
+    }
+    
+    ma_audio_buffer_ref buffer;
+    ma_audio_buffer_ref_init(ma_format_f32, kBenchChannels, burst.data(), burst.size() / kBenchChannels, &buffer);
+    ma_data_source_node_config sourceConfig = ma_data_source_node_config_init(&buffer);
+    ma_data_source_node source;
+    ma_data_source_node_init(&graph, &sourceConfig, nullptr, &source);
+    
+    ReverbParams params;
+    params.roomSize = 0.8f;
+    ReverbNode reverb;
+    reverb.setIdleBypass(idleBypass);
+    reverb.init(&graph, kBenchChannels, kBenchSampleRate, params);
+    ma_node_attach_output_bus(&source, 0, reverb.node(), 0);
+    ma_node_attach_output_bus(reverb.node(), 0, ma_node_graph_get_endpoint(&graph), 0);
+    
+    std::vector<float> block(kBenchBlockFrames * kBenchChannels);
+    ma_uint64 totalFrames = static_cast<ma_uint64>(seconds * kBenchSampleRate);
+    std::clock_t start = std::clock();
+    for (ma_uint64 frame = 0; frame < totalFrames; frame += kBenchBlockFrames) {
+        ma_node_graph_read_pcm_frames(&graph, block.data(), kBenchBlockFrames, nullptr);
+        if (run.idleAfterMs < 0.0 && reverb.isIdle()) {
+            run.idleAfterMs = frame * 1000.0 / kBenchSampleRate;
+        }
+    }
+    run.cpuSeconds = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+    
+    reverb.uninit();
+    ma_data_source_node_uninit(&source, nullptr);
+    ma_audio_buffer_ref_uninit(&buffer);
+    ma_node_graph_uninit(&graph, nullptr);
+    return run;
+}
+
+int bench_reverb_idle() {
+    const double seconds = 600.0;
+    std::cout << "Reverb after one 50 ms burst, " << seconds << " s of audio in "
+              << kBenchBlockFrames << "-frame passes" << std::endl;
+    
+    IdleRun always = run_reverb_idle(false, seconds);
+    IdleRun bypass = run_reverb_idle(true, seconds);
+    
+    auto print = [&](const char* label, const IdleRun& run) {
+        std::cout << "  " << label << run.cpuSeconds * 1000.0 << " ms CPU, "
+                  << run.cpuSeconds / seconds * 100.0 << "% of one core";
+        if (run.idleAfterMs >= 0.0) {
+            std::cout << ", idle after " << run.idleAfterMs << " ms";
+        }
+        std::cout << std::endl;
+    };
+    print("always processing: ", always);
+    print("idle bypass:       ", bypass);
+    if (bypass.cpuSeconds > 0.0) {
+        std::cout << "  " << always.cpuSeconds / bypass.cpuSeconds << "x less CPU while idle" << std::endl;
+    }
+    return 0;
+}
+
+// Each kernel runs the same noise through its own copy of one reverb state, so the outputs can be
+// compared against verblib_process sample for sample
+int bench_reverb_kernel() {
+    const double seconds = 60.0;
+    const ma_uint32 frames = static_cast<ma_uint32>(seconds * kBenchSampleRate);
+    
+    std::vector<float> input(static_cast<size_t>(frames) * kBenchChannels);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    for (float& sample : input) {
+        sample = noise(rng);
+    }
+    
+    // verblib keeps its delay lines inline, which makes it too big for the stack
+    std::unique_ptr<verblib> initial(new verblib());
+    verblib_initialize(initial.get(), kBenchSampleRate, kBenchChannels);
+    verblib_set_room_size(initial.get(), 0.8f);
+    verblib_set_wet(initial.get(), 0.3f);
+    verblib_set_dry(initial.get(), 0.7f);
+    
+    std::unique_ptr<verblib> state(new verblib());
+    std::vector<float> reference(input.size());
+    std::vector<float> output(input.size());
+    
+    std::cout << "Reverb kernels, " << seconds << " s of stereo noise in " << kBenchBlockFrames
+              << "-frame blocks (selected: " << ReverbKernel::name(ReverbKernel::best()) << ")" << std::endl;
+    
+    double scalarRate = 0.0;
+    const ReverbKernel::Kind kinds[] = {ReverbKernel::SCALAR, ReverbKernel::SSE2, ReverbKernel::AVX, ReverbKernel::NEON};
+    for (ReverbKernel::Kind kind : kinds) {
+        if (!ReverbKernel::supported(kind)) continue;
+        
+        // The delay lines point into the struct, so copy it and re-point them
+        std::memcpy(state.get(), initial.get(), sizeof(verblib));
+        for (int i = 0; i < verblib_numcombs; i++) {
+            state->combL[i].buffer += reinterpret_cast<float*>(state.get()) - reinterpret_cast<float*>(initial.get());
+            state->combR[i].buffer += reinterpret_cast<float*>(state.get()) - reinterpret_cast<float*>(initial.get());
+        }
+        for (int i = 0; i < verblib_numallpasses; i++) {
+            state->allpassL[i].buffer += reinterpret_cast<float*>(state.get()) - reinterpret_cast<float*>(initial.get());
+            state->allpassR[i].buffer += reinterpret_cast<float*>(state.get()) - reinterpret_cast<float*>(initial.get());
+        }
+        
+        std::vector<float>& out = kind == ReverbKernel::SCALAR ? reference : output;
+        std::clock_t start = std::clock();
+        for (ma_uint32 frame = 0; frame < frames; frame += kBenchBlockFrames) {
+            ma_uint32 count = std::min(kBenchBlockFrames, frames - frame);
+            size_t offset = static_cast<size_t>(frame) * kBenchChannels;
+            ReverbKernel::process(kind, state.get(), input.data() + offset, out.data() + offset, count);
+        }
+        double cpuSeconds = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+        double rate = cpuSeconds > 0.0 ? frames / cpuSeconds : 0.0;
+        
+        std::cout << "  " << ReverbKernel::name(kind) << ": " << static_cast<uint64_t>(rate) << " frames/s";
+        if (kind == ReverbKernel::SCALAR) {
+            scalarRate = rate;
+        } else {
+            size_t mismatches = 0;
+            float maxError = 0.0f;
+            for (size_t i = 0; i < out.size(); i++) {
+                if (out[i] != reference[i]) mismatches++;
+                maxError = std::max(maxError, std::fabs(out[i] - reference[i]));
+            }
+            if (scalarRate > 0.0) {
+                std::cout << ", " << rate / scalarRate << "x scalar";
+            }
+            if (mismatches == 0) {
+                std::cout << ", bit-identical";
+            } else {
+                std::cout << ", " << mismatches << " samples differ (max " << maxError << ")";
+            }
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+// Loops a second of noise through an echo with the given taps and returns the CPU time
+double run_echo(const EchoLayout& layout, double seconds) {
+    ma_node_graph_config graphConfig = ma_node_graph_config_init(kBenchChannels);
+    ma_node_graph graph;
+    if (ma_node_graph_init(&graphConfig, nullptr, &graph) != MA_SUCCESS) return 0.0;
+    
+    std::vector<float> input(kBenchSampleRate * kBenchChannels);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    for (float& sample : input) {
+        sample = noise(rng);
+    }
+    
+    ma_audio_buffer_ref buffer;
+    ma_audio_buffer_ref_init(ma_format_f32, kBenchChannels, input.data(), kBenchSampleRate, &buffer);
+    ma_data_source_set_looping(&buffer, MA_TRUE);
+    ma_data_source_node_config sourceConfig = ma_data_source_node_config_init(&buffer);
+    ma_data_source_node source;
+    ma_data_source_node_init(&graph, &sourceConfig, nullptr, &source);
+    
+    EchoParams params;
+    params.decay = 0.7f;
+    params.feedback = 0.3f;
+    params.damping = 0.2f;
+    EchoNode echo;
+    echo.init(&graph, kBenchChannels, kBenchSampleRate, layout, params);
+    ma_node_attach_output_bus(&source, 0, echo.node(), 0);
+    ma_node_attach_output_bus(echo.node(), 0, ma_node_graph_get_endpoint(&graph), 0);
+    
+    std::vector<float> block(kBenchBlockFrames * kBenchChannels);
+    ma_uint64 totalFrames = static_cast<ma_uint64>(seconds * kBenchSampleRate);
+    std::clock_t start = std::clock();
+    for (ma_uint64 frame = 0; frame < totalFrames; frame += kBenchBlockFrames) {
+        ma_node_graph_read_pcm_frames(&graph, block.data(), kBenchBlockFrames, nullptr);
+    }
+    double cpuSeconds = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+    
+    echo.uninit();
+    ma_data_source_node_uninit(&source, nullptr);
+    ma_audio_buffer_ref_uninit(&buffer);
+    ma_node_graph_uninit(&graph, nullptr);
+    return cpuSeconds;
+}
+
+// The same taps, 50 ms apart, as an evenly spaced echo (recursive sum) and as an explicit tap list
+int bench_echo_taps() {
+    const double seconds = 30.0;
+    const ma_uint32 spacingFrames = kBenchSampleRate / 20;
+    std::cout << "Echo, " << seconds << " s of stereo noise in " << kBenchBlockFrames
+              << "-frame passes, frames/s by tap count" << std::endl;
+    
+    for (ma_uint32 tapCount : {1u, 4u, 16u, 64u}) {
+        EchoLayout evenly;
+        evenly.spacingFrames = spacingFrames;
+        evenly.tapCount = tapCount;
+        
+        EchoLayout explicitTaps;
+        for (ma_uint32 k = 1; k <= tapCount; k++) {
+            EchoTap tap;
+            tap.delayFrames = k * spacingFrames;
+            tap.gain = std::pow(0.7f, static_cast<float>(k));
+            explicitTaps.taps.push_back(tap);
+        }
+        
+        double evenlySeconds = run_echo(evenly, seconds);
+        double explicitSeconds = run_echo(explicitTaps, seconds);
+        std::cout << "  " << tapCount << " taps: evenly spaced "
+                  << static_cast<uint64_t>(evenlySeconds > 0.0 ? seconds * kBenchSampleRate / evenlySeconds : 0.0)
+                  << ", explicit list "
+                  << static_cast<uint64_t>(explicitSeconds > 0.0 ? seconds * kBenchSampleRate / explicitSeconds : 0.0)
+                  << std::endl;
+    }
+    return 0;
+}
+
+// Plays voiceCount copies of a sound through a real offline player and returns the CPU time of
+// the mix. Everything but the spatial settings is left at its defaults
+double run_spatial_voices(const std::string& path, int voiceCount, bool spatialize, SpatialMode mode, double seconds) {
+    std::unique_ptr<AudioPlayer> player = AudioPlayer::create();
+    if (!player->initializeOffline(kBenchChannels, kBenchSampleRate)) return 0.0;
+    player->setRandomSeed(1);
+    player->setMaxConcurrentSounds(std::max(voiceCount, 1));
+    
+    AudioEffectsConfig effects;
+    effects.enableSpatializer = spatialize;
+    effects.spatialMode = mode;
+    player->setAudioEffects(effects);
+    player->preloadSounds({path});
+    for (int i = 0; i < voiceCount; i++) {
+        player->playSoundWithIdAndVolume(path, 0.1f, true);
+    }
+    
+    std::vector<float> block(kBenchBlockFrames * kBenchChannels);
+    ma_uint64 totalFrames = static_cast<ma_uint64>(seconds * kBenchSampleRate);
+    std::clock_t start = std::clock();
+    for (ma_uint64 frame = 0; frame < totalFrames; frame += kBenchBlockFrames) {
+        player->renderFrames(block.data(), kBenchBlockFrames);
+    }
+    double cpuSeconds = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+    player->cleanup();
+    return cpuSeconds;
+}
+
+// What one playing voice costs in each spatial mode, from the mix time with voiceCount voices minus
+// the time with none. The sound is noise written to a temporary WAV file, long enough to play throughout
+int bench_spatial_voices() {
+    const int voiceCount = 256;
+    const double seconds = 10.0;
+    std::string path = (std::filesystem::temp_directory_path() / "clicksounds_bench_noise.wav").string();
+    
+    std::vector<float> noiseFrames(static_cast<size_t>((seconds + 1.0) * kBenchSampleRate) * kBenchChannels);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    for (float& sample : noiseFrames) {
+        sample = noise(rng);
+    }
+    ma_encoder_config encoderConfig = ma_encoder_config_init(ma_encoding_format_wav, ma_format_f32, kBenchChannels, kBenchSampleRate);
+    ma_encoder encoder;
+    if (ma_encoder_init_file(path.c_str(), &encoderConfig, &encoder) != MA_SUCCESS) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return 1;
+    }
+    ma_encoder_write_pcm_frames(&encoder, noiseFrames.data(), noiseFrames.size() / kBenchChannels, nullptr);
+    ma_encoder_uninit(&encoder);
+    
+    struct Mode {
+        const char* label;
+        bool spatialize;
+        SpatialMode mode;
+    };
+    const Mode modes[] = {
+        {"no placement", false, SpatialMode::FULL_3D},
+        {"pan         ", true, SpatialMode::PAN},
+        {"3d          ", true, SpatialMode::FULL_3D},
+    };
+    
+    // Best of a few runs, since the differences are small next to the rest of the mix
+    const int runs = 3;
+    double emptySeconds = 0.0;
+    double results[3] = {};
+    for (int run = 0; run < runs; run++) {
+        double empty = run_spatial_voices(path, 0, false, SpatialMode::FULL_3D, seconds);
+        emptySeconds = run == 0 ? empty : std::min(emptySeconds, empty);
+        for (int i = 0; i < 3; i++) {
+            double cpuSeconds = run_spatial_voices(path, voiceCount, modes[i].spatialize, modes[i].mode, seconds);
+            results[i] = run == 0 ? cpuSeconds : std::min(results[i], cpuSeconds);
+        }
+    }
+    std::filesystem::remove(path);
+    
+    std::cout << "Spatial modes, " << voiceCount << " voices for " << seconds << " s in "
+              << kBenchBlockFrames << "-frame passes" << std::endl;
+    for (int i = 0; i < 3; i++) {
+        double perVoice = (results[i] - emptySeconds) / voiceCount / seconds;
+        std::cout << "  " << modes[i].label << "  " << perVoice * 1e6 << " us CPU per voice per second of audio ("
+                  << perVoice * 100.0 << "% of one core)" << std::endl;
+    }
+    return 0;
+}
+
+struct KeyStroke {
+    int keyCode;
+    int timeMs;
+    bool down;
+};
+
+// Keyboard handler settings shared by both table layouts
+struct KeyHandlerSettings {
+    int debounceMs = 50;
+    int soundCount = 8;
+};
+
+// The keyboard handler's bookkeeping as it was before the flat key tables: one hash container per
+// piece of per-key state. Same decisions as ClickSoundsApp::handleKeyboardEvent, minus the audio
+struct HashedKeyHandler {
+    KeyHandlerSettings settings;
+    std::unordered_set<int> excludedKeys;
+    std::unordered_set<int> noRepeatKeys;
+    std::unordered_map<int, int> keySoundMap;
+    std::unordered_set<int> pressedKeys;
+    std::unordered_map<int, int> lastKeyPressTime;
+    std::unordered_map<int, int> activeKeySounds;
+    std::mt19937 rng{1};
+    int nextSoundId = 1;
+    
+    // Returns the sound index played, or -1
+    int keyDown(int keyCode, int timeMs) {
+        if (excludedKeys.count(keyCode)) return -1;
+        auto lastTimeIt = lastKeyPressTime.find(keyCode);
+        if (lastTimeIt != lastKeyPressTime.end() && timeMs - lastTimeIt->second < settings.debounceMs) return -1;
+        if (noRepeatKeys.count(keyCode) && pressedKeys.count(keyCode)) return -1;
+        lastKeyPressTime[keyCode] = timeMs;
+        pressedKeys.insert(keyCode);
+        if (keySoundMap.find(keyCode) == keySoundMap.end()) {
+            std::uniform_int_distribution<int> dist(0, settings.soundCount - 1);
+            keySoundMap[keyCode] = dist(rng);
+        }
+        activeKeySounds[keyCode] = nextSoundId++;
+        return keySoundMap[keyCode];
+    }
+    
+    // Returns the sound to fade out, or 0
+    int keyUp(int keyCode) {
+        if (excludedKeys.count(keyCode)) return 0;
+        pressedKeys.erase(keyCode);
+        lastKeyPressTime.erase(keyCode);
+        auto it = activeKeySounds.find(keyCode);
+        if (it == activeKeySounds.end()) return 0;
+        int soundId = it->second;
+        activeKeySounds.erase(it);
+        return soundId;
+    }
+};
+
+// The same handler on KeyStateTable and key bitsets
+struct FlatKeyHandler {
+    KeyHandlerSettings settings;
+    KeySet excludedKeys;
+    KeySet noRepeatKeys;
+    KeyStateTable keys;
+    std::mt19937 rng{1};
+    int nextSoundId = 1;
+    
+    int keyDown(int keyCode, int timeMs) {
+        if (!KeyStateTable::contains(keyCode) || excludedKeys[keyCode]) return -1;
+        KeyState& key = keys[keyCode];
+        bool held = keys.isPressed(keyCode);
+        if (held && timeMs - key.lastPressMs < settings.debounceMs) return -1;
+        if (noRepeatKeys[keyCode] && held) return -1;
+        key.lastPressMs = timeMs;
+        keys.setPressed(keyCode, true);
+        if (key.soundIndex < 0) {
+            std::uniform_int_distribution<int> dist(0, settings.soundCount - 1);
+            key.soundIndex = dist(rng);
+        }
+        key.soundId = nextSoundId++;
+        return key.soundIndex;
+    }
+    
+    int keyUp(int keyCode) {
+        if (!KeyStateTable::contains(keyCode) || excludedKeys[keyCode]) return 0;
+        KeyState& key = keys[keyCode];
+        keys.setPressed(keyCode, false);
+        int soundId = key.soundId;
+        key.soundId = 0;
+        return soundId;
+    }
+};
+
+// Typing on the letter keys, space and shift at about 12 keys a second. One press in twenty is held
+// long enough to auto-repeat
+std::vector<KeyStroke> typing_stream(size_t keystrokes) {
+    std::vector<int> keyCodes = {0x20, 0x10};
+    for (int letter = 'A'; letter <= 'Z'; letter++) {
+        keyCodes.push_back(letter);
+    }
+    
+    std::vector<KeyStroke> stream;
+    stream.reserve(keystrokes * 3);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<size_t> pickKey(0, keyCodes.size() - 1);
+    std::uniform_int_distribution<int> gapMs(40, 120);
+    std::uniform_int_distribution<int> holdChance(0, 19);
+    int timeMs = 0;
+    for (size_t i = 0; i < keystrokes; i++) {
+        int keyCode = keyCodes[pickKey(rng)];
+        stream.push_back({keyCode, timeMs, true});
+        if (holdChance(rng) == 0) {
+            // Auto-repeat after 500 ms, then every 33 ms
+            for (int repeatMs = 500; repeatMs < 800; repeatMs += 33) {
+                stream.push_back({keyCode, timeMs + repeatMs, true});
+            }
+            timeMs += 800;
+        } else {
+            timeMs += 30 + gapMs(rng) / 2;
+        }
+        stream.push_back({keyCode, timeMs, false});
+        timeMs += gapMs(rng);
+    }
+    return stream;
+}
+
+// Feeds the stream through a handler `passes` times and returns the CPU time. The checksum keeps
+// the work from being optimized away and shows both handlers made the same decisions
+template <typename Handler>
+double run_key_handler(Handler& handler, const std::vector<KeyStroke>& stream, int passes, uint64_t& checksum) {
+    std::clock_t start = std::clock();
+    for (int pass = 0; pass < passes; pass++) {
+        int offsetMs = pass * (stream.back().timeMs + 1000);
+        for (const KeyStroke& stroke : stream) {
+            if (stroke.down) {
+                checksum = checksum * 31 + static_cast<uint64_t>(handler.keyDown(stroke.keyCode, stroke.timeMs + offsetMs) + 1);
+            } else {
+                checksum = checksum * 31 + static_cast<uint64_t>(handler.keyUp(stroke.keyCode));
+            }
+        }
+    }
+    return static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+}
+
+// Key events per second through the keyboard handler's bookkeeping, hash containers against the
+// flat key tables. The audio calls are left out: this is the part that runs on every keystroke
+// whatever the sound settings are
+int bench_key_state() {
+    const int passes = 20;
+    std::vector<KeyStroke> stream = typing_stream(100000);
+    
+    HashedKeyHandler hashed;
+    FlatKeyHandler flat;
+    for (int keyCode : {0x5B, 0x5C}) {
+        hashed.excludedKeys.insert(keyCode);
+        flat.excludedKeys.set(keyCode);
+    }
+    hashed.noRepeatKeys.insert(0x10);
+    flat.noRepeatKeys.set(0x10);
+    
+    uint64_t hashedChecksum = 0;
+    uint64_t flatChecksum = 0;
+    double hashedSeconds = run_key_handler(hashed, stream, passes, hashedChecksum);
+    double flatSeconds = run_key_handler(flat, stream, passes, flatChecksum);
+    
+    double events = static_cast<double>(stream.size()) * passes;
+    std::cout << "Key state, " << static_cast<uint64_t>(events) << " key events of simulated typing" << std::endl;
+    std::cout << "  hash containers  " << static_cast<uint64_t>(hashedSeconds > 0.0 ? events / hashedSeconds : 0.0)
+              << " events/s" << std::endl;
+    std::cout << "  flat key tables  " << static_cast<uint64_t>(flatSeconds > 0.0 ? events / flatSeconds : 0.0)
+              << " events/s" << std::endl;
+    if (hashedChecksum != flatChecksum) {
+        std::cerr << "Key state handlers disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+struct Benchmark {
+    const char* name;
+    const char* description;
+    int (*run)();
+};
+
+const Benchmark kBenchmarks[] = {
+    {"reverb-idle", "Reverb CPU while waiting for the next keystroke, with and without the idle bypass", bench_reverb_idle},
+    {"reverb-kernel", "Frames per second of each SIMD reverb kernel against verblib_process", bench_reverb_kernel},
+    {"spatial-voices", "Per-voice mixing cost of spatial_mode \"pan\" against the 3D spatializer", bench_spatial_voices},
+    {"echo-taps", "Echo cost as the tap count grows, evenly spaced against an explicit tap list", bench_echo_taps},
+    {"key-state", "Key events per second through the keyboard handler's per-key bookkeeping", bench_key_state},
+};
+
+} // namespace
+
+int Benchmarks::run(const std::string& name) {
+    for (const Benchmark& benchmark : kBenchmarks) {
+        if (name == benchmark.name || name == "all") {
+            int result = benchmark.run();
+            if (result != 0 || name != "all") return result;
+        }
+    }
+    if (name == "all") return 0;
+    
+    std::cerr << "Unknown benchmark: " << name << std::endl;
+    list();
+    return 1;
+}
+
+void Benchmarks::list() {
+    std::cout << "Benchmarks (--bench NAME, or all):\n";
+    for (const Benchmark& benchmark : kBenchmarks) {
+        std::cout << "  " << benchmark.name << "  " << benchmark.description << "\n";
+    }
+}
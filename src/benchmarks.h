@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+
+// Self-contained micro-benchmarks for the hot paths, run with --bench NAME. They need no sound
+// card, input devices or config, and print their own results
+class Benchmarks {
+public:
+    // Returns the process exit code; unknown names list what is available
+    static int run(const std::string& name);
+    static void list();
+};
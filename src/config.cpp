@@ -4,6 +4,8 @@
 #include <fstream>
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <unordered_set>
 
 using json = nlohmann::json;
 namespace fs = std::filesystem;
@@ -17,18 +19,113 @@ std::vector<std::string> Config::loadSoundsFromDirectory(const std::string& dir)
     }
     
     for (const auto& entry : fs::directory_iterator(dir)) {
-        if (entry.is_regular_file()) {
-            auto ext = entry.path().extension().string();
-            if (ext == ".wav" || ext == ".mp3" || ext == ".ogg" || 
-                ext == ".flac" || ext == ".m4a") {
-                sounds.push_back(entry.path().string());
-            }
+        if (entry.is_regular_file() && isSoundFile(entry.path().string())) {
+            sounds.push_back(entry.path().string());
+        }
+    }
+    
+    return sounds;
+}
+
+bool Config::isSoundFile(const std::string& filepath) {
+    auto ext = fs::path(filepath).extension().string();
+    return ext == ".wav" || ext == ".mp3" || ext == ".ogg" ||
+           ext == ".flac" || ext == ".m4a";
+}
+
+// Groups of keys that keyboard.key_sounds accepts next to single key names
+static bool key_group_keys(const std::string& group, KeySet& keys) {
+    static const char* const modifiers[] = {"lshift", "rshift", "lctrl", "rctrl", "lalt", "ralt", "lwin", "rwin", "capslock"};
+    static const char* const enter[] = {"enter", "numpadenter"};
+    
+    if (group == "modifiers") {
+        for (const char* name : modifiers) keys.set(KeyMapping::getKeyCode(name));
+    } else if (group == "enter") {
+        for (const char* name : enter) keys.set(KeyMapping::getKeyCode(name));
+    } else if (group == "alphanumeric") {
+        char name[2] = {};
+        for (char c = 'a'; c <= 'z'; c++) {
+            name[0] = c;
+            keys.set(KeyMapping::getKeyCode(name));
         }
+        for (char c = '0'; c <= '9'; c++) {
+            name[0] = c;
+            keys.set(KeyMapping::getKeyCode(name));
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Samples for one layer: the "sounds" list, relative to "sounds_dir" when that is given and to the
+// keyboard's sounds_dir otherwise, or without a list every sound file in "sounds_dir"
+std::vector<std::string> Config::loadKeySoundFiles(const nlohmann::json& j, const std::string& keyboardDir) {
+    std::string dir = j.value("sounds_dir", "");
+    if (!j.contains("sounds")) {
+        return dir.empty() ? std::vector<std::string>() : loadSoundsFromDirectory(dir);
     }
     
+    std::vector<std::string> sounds;
+    for (const auto& file : j["sounds"]) {
+        if (file.is_string()) {
+            sounds.push_back((dir.empty() ? keyboardDir : dir) + "/" + file.get<std::string>());
+        }
+    }
     return sounds;
 }
 
+std::vector<std::string> Config::getSoundFiles() const {
+    std::vector<std::string> files;
+    std::unordered_set<std::string> seen;
+    
+    auto add = [&](const std::string& path) {
+        // Unset mouse sounds end up as just the directory, skip those
+        if (path.empty() || path.back() == '/') return;
+        if (seen.insert(path).second) {
+            files.push_back(path);
+        }
+    };
+    
+    for (const auto* path : { &mouse.leftDown, &mouse.leftUp, &mouse.rightDown, &mouse.rightUp,
+                              &mouse.middleDown, &mouse.middleUp, &mouse.x1Down, &mouse.x1Up,
+                              &mouse.x2Down, &mouse.x2Up, &mouse.wheelUp, &mouse.wheelDown }) {
+        add(*path);
+    }
+    
+    for (const auto& path : keyboard.sounds) {
+        add(path);
+    }
+    
+    for (const auto& set : keyboard.keySounds) {
+        for (const auto& layer : set.layers) {
+            for (const auto& path : layer.sounds) {
+                add(path);
+            }
+        }
+    }
+    
+    return files;
+}
+
+std::vector<std::string> Config::getSoundDirectories() const {
+    std::vector<std::string> directories;
+    std::unordered_set<std::string> seen;
+    
+    auto add = [&](const std::string& dir) {
+        std::string path = dir.empty() ? "." : dir;
+        if (seen.insert(path).second && fs::is_directory(path)) {
+            directories.push_back(path);
+        }
+    };
+    
+    if (!keyboard.soundsDir.empty()) add(keyboard.soundsDir); // Watched even while it has no sounds yet
+    for (const auto& file : getSoundFiles()) {
+        add(fs::path(file).parent_path().string());
+    }
+    return directories;
+}
+
 Config Config::loadFromFile(const std::string& filepath) {
     Config config;
     config.filepath_ = filepath; // Store the file path for reloading
@@ -44,6 +141,7 @@ Config Config::loadFromFile(const std::string& filepath) {
         file >> j;
         
         config.parseFromJson(j);
+        config.json_ = j;
         
     } catch (const std::exception& e) {
         std::cerr << "Error loading config: " << e.what() << std::endl;
@@ -52,7 +150,7 @@ Config Config::loadFromFile(const std::string& filepath) {
     return config;
 }
 
-bool Config::reload() {
+bool Config::reload(ConfigDiff& diff) {
     if (filepath_.empty()) {
         std::cerr << "Cannot reload config: no file path stored" << std::endl;
         return false;
@@ -68,12 +166,32 @@ bool Config::reload() {
         json j;
         file >> j;
         
-        // Clear existing data before parsing
-        mouse = MouseConfig{};
-        keyboard = KeyboardConfig{};
-        audio = AudioConfig{};
+        // Parse into a fresh config, so defaults apply to whatever the file leaves out
+        Config next;
+        next.parseFromJson(j);
+        diff = this->diff(next, j);
         
-        parseFromJson(j);
+        // Unchanged settings aren't touched
+        if (diff.mouse) {
+            mouse = next.mouse;
+        } else if (diff.mouseVolume) {
+            mouse.volume = next.mouse.volume;
+        }
+        if (diff.keyboard) {
+            keyboard = next.keyboard;
+        } else if (diff.keyboardVolume) {
+            keyboard.volume = next.keyboard.volume;
+        }
+        if (diff.masterVolume) audio.masterVolume = next.audio.masterVolume;
+        if (diff.maxConcurrentSounds) audio.maxConcurrentSounds = next.audio.maxConcurrentSounds;
+        if (diff.voiceStealing) audio.voiceStealing = next.audio.voiceStealing;
+        if (diff.effects) audio.effects = next.audio.effects;
+        if (diff.soundPack) audio.soundPack = next.audio.soundPack;
+        if (diff.samples) audio.samples = next.audio.samples;
+        if (diff.latency) audio.latency = next.audio.latency;
+        if (diff.audio) audio.asyncPlayback = next.audio.asyncPlayback;
+        if (diff.hotReload) hotReload = next.hotReload;
+        json_ = j;
         
         std::cout << "Config reloaded successfully from: " << filepath_ << std::endl;
         return true;
@@ -84,6 +202,94 @@ bool Config::reload() {
     }
 }
 
+// Settings are compared as the file spells them, section by section, plus the sound files the
+// directories resolve to, since those can change without the file changing
+ConfigDiff Config::diff(const Config& next, const nlohmann::json& nextJson) const {
+    ConfigDiff diff;
+    
+    // Calls changed(key) for every key of the section whose value differs between the two files
+    auto forChangedKeys = [&](const char* section, const auto& changed) {
+        json before = json_.is_object() ? json_.value(section, json::object()) : json::object();
+        json after = nextJson.value(section, json::object());
+        for (const auto* side : {&before, &after}) {
+            for (const auto& item : side->items()) {
+                const std::string& key = item.key();
+                if (side == &after && before.contains(key)) continue; // Already compared
+                if (before.value(key, json()) != after.value(key, json())) changed(key);
+            }
+        }
+    };
+    
+    forChangedKeys("mouse", [&](const std::string& key) {
+        if (key == "volume") {
+            diff.mouseVolume = true;
+        } else {
+            diff.mouse = true;
+        }
+    });
+    forChangedKeys("keyboard", [&](const std::string& key) {
+        if (key == "volume") {
+            diff.keyboardVolume = true;
+        } else {
+            diff.keyboard = true;
+            if (key == "key_sounds") diff.keySounds = true;
+        }
+    });
+    forChangedKeys("audio", [&](const std::string& key) {
+        if (key == "master_volume") diff.masterVolume = true;
+        else if (key == "max_concurrent_sounds") diff.maxConcurrentSounds = true;
+        else if (key == "voice_stealing") diff.voiceStealing = true;
+        else if (key == "effects") diff.effects = true;
+        else if (key == "sound_pack") diff.soundPack = true;
+        else if (key == "samples") diff.samples = true;
+        else if (key == "latency") diff.latency = true;
+        else diff.audio = true;
+    });
+    forChangedKeys("hot_reload", [&](const std::string&) {
+        diff.hotReload = true;
+    });
+    
+    if (keyboard.sounds != next.keyboard.sounds) {
+        diff.keyboard = true;
+        diff.keyboardSounds = true;
+    }
+    if (getSoundFiles() != next.getSoundFiles()) {
+        diff.soundFiles = true;
+        diff.keyboard = true; // Also covers key_sounds directories that gained or lost files
+        diff.keySounds = true;
+    }
+    return diff;
+}
+
+bool ConfigDiff::any() const {
+    return mouse || keyboard || mouseVolume || keyboardVolume || masterVolume || maxConcurrentSounds ||
+           voiceStealing || effects || soundPack || samples || latency || audio || hotReload;
+}
+
+std::string ConfigDiff::describe() const {
+    std::string text;
+    auto add = [&](bool changed, const char* name) {
+        if (!changed) return;
+        if (!text.empty()) text += ", ";
+        text += name;
+    };
+    add(mouse, "mouse");
+    add(mouseVolume && !mouse, "mouse volume");
+    add(keyboard, "keyboard");
+    add(keyboardVolume && !keyboard, "keyboard volume");
+    add(soundFiles, "sound files");
+    add(masterVolume, "master volume");
+    add(maxConcurrentSounds, "max concurrent sounds");
+    add(voiceStealing, "voice stealing");
+    add(effects, "effects");
+    add(soundPack, "sound pack");
+    add(samples, "sample loading");
+    add(latency, "latency");
+    add(audio, "audio");
+    add(hotReload, "hot reload");
+    return text;
+}
+
 void Config::parseFromJson(const nlohmann::json& j) {
     // Mouse config
     if (j.contains("mouse")) {
@@ -94,6 +300,7 @@ void Config::parseFromJson(const nlohmann::json& j) {
         mouse.enableSideButtons = mouse_json.value("enable_side_buttons", false);
         mouse.enableFadeOut = mouse_json.value("enable_fade_out", false);
         mouse.fadeOutDurationMs = mouse_json.value("fade_out_duration_ms", 50);
+        mouse.attackMs = mouse_json.value("attack_ms", 0);
         mouse.scrollWheelDebounceMs = mouse_json.value("scroll_wheel_debounce_ms", 50);
         mouse.volume = mouse_json.value("volume", 1.0f);
         
@@ -124,6 +331,7 @@ void Config::parseFromJson(const nlohmann::json& j) {
         keyboard.disableRepeat = keyboard_json.value("disable_repeat", false);
         keyboard.enableFadeOut = keyboard_json.value("enable_fade_out", false);
         keyboard.fadeOutDurationMs = keyboard_json.value("fade_out_duration_ms", 50);
+        keyboard.attackMs = keyboard_json.value("attack_ms", 0);
         keyboard.keyRepeatDebounceMs = keyboard_json.value("key_repeat_debounce_ms", 50);
         keyboard.volume = keyboard_json.value("volume", 1.0f);
         
@@ -136,10 +344,10 @@ void Config::parseFromJson(const nlohmann::json& j) {
                 if (key.is_string()) {
                     int keyCode = KeyMapping::getKeyCode(key.get<std::string>());
                     if (keyCode != -1) {
-                        keyboard.noRepeatKeys.insert(keyCode);
+                        keyboard.noRepeatKeys.set(keyCode);
                     }
-                } else if (key.is_number()) {
-                    keyboard.noRepeatKeys.insert(key.get<int>());
+                } else if (key.is_number() && KeyStateTable::contains(key.get<int>())) {
+                    keyboard.noRepeatKeys.set(key.get<int>());
                 }
             }
         }
@@ -149,13 +357,71 @@ void Config::parseFromJson(const nlohmann::json& j) {
                 if (key.is_string()) {
                     int keyCode = KeyMapping::getKeyCode(key.get<std::string>());
                     if (keyCode != -1) {
-                        keyboard.excludedKeys.insert(keyCode);
+                        keyboard.excludedKeys.set(keyCode);
                     }
-                } else if (key.is_number()) {
-                    keyboard.excludedKeys.insert(key.get<int>());
+                } else if (key.is_number() && KeyStateTable::contains(key.get<int>())) {
+                    keyboard.excludedKeys.set(key.get<int>());
                 }
             }
         }
+        
+        if (keyboard_json.contains("key_sounds") && keyboard_json["key_sounds"].is_object()) {
+            std::vector<KeySoundSet> keySets;
+            for (const auto& entry : keyboard_json["key_sounds"].items()) {
+                KeySoundSet set;
+                set.name = entry.key();
+                bool group = key_group_keys(set.name, set.keys);
+                if (!group) {
+                    int keyCode = KeyMapping::getKeyCode(set.name);
+                    if (keyCode == -1) {
+                        std::cerr << "Unknown key or key group in key_sounds: " << set.name << ", ignoring it" << std::endl;
+                        continue;
+                    }
+                    set.keys.set(keyCode);
+                }
+                
+                // A string is shorthand for a directory of samples
+                const auto& value = entry.value();
+                if (value.is_string()) {
+                    KeySoundLayer layer;
+                    layer.sounds = loadSoundsFromDirectory(value.get<std::string>());
+                    set.layers.push_back(layer);
+                } else if (value.is_object()) {
+                    std::string order = value.value("order", "random");
+                    if (order == "round_robin") set.order = KeySoundOrder::ROUND_ROBIN;
+                    else if (order != "random") {
+                        std::cerr << "Unknown key_sounds order: " << order << ", using \"random\"" << std::endl;
+                    }
+                    
+                    if (value.contains("layers") && value["layers"].is_array()) {
+                        for (const auto& layer_json : value["layers"]) {
+                            KeySoundLayer layer;
+                            layer.minKeysPerSecond = std::max(0.0f, layer_json.value("min_keys_per_second", 0.0f));
+                            layer.sounds = loadKeySoundFiles(layer_json, keyboard.soundsDir);
+                            set.layers.push_back(layer);
+                        }
+                    } else {
+                        KeySoundLayer layer;
+                        layer.sounds = loadKeySoundFiles(value, keyboard.soundsDir);
+                        set.layers.push_back(layer);
+                    }
+                }
+                
+                std::stable_sort(set.layers.begin(), set.layers.end(), [](const KeySoundLayer& a, const KeySoundLayer& b) {
+                    return a.minKeysPerSecond < b.minKeysPerSecond;
+                });
+                set.layers.erase(std::remove_if(set.layers.begin(), set.layers.end(), [](const KeySoundLayer& layer) {
+                    return layer.sounds.empty();
+                }), set.layers.end());
+                if (set.layers.empty()) {
+                    std::cerr << "No sounds for key_sounds entry: " << set.name << ", ignoring it" << std::endl;
+                    continue;
+                }
+                
+                (group ? keyboard.keySounds : keySets).push_back(set);
+            }
+            keyboard.keySounds.insert(keyboard.keySounds.end(), keySets.begin(), keySets.end());
+        }
     }
     
     // Audio config
@@ -164,6 +430,29 @@ void Config::parseFromJson(const nlohmann::json& j) {
         audio.asyncPlayback = audio_json.value("async_playback", true);
         audio.maxConcurrentSounds = audio_json.value("max_concurrent_sounds", 32);
         audio.masterVolume = audio_json.value("master_volume", 1.0f);
+        audio.soundPack = audio_json.value("sound_pack", "");
+        
+        if (audio_json.contains("samples")) {
+            auto& samples = audio_json["samples"];
+            audio.samples.trimSilence = samples.value("trim_silence", true);
+            audio.samples.trimThresholdDb = samples.value("trim_threshold_db", -60.0f);
+            audio.samples.normalizeLoudness = samples.value("normalize_loudness", false);
+            audio.samples.targetLoudnessDb = samples.value("target_loudness_db", -30.0f);
+            
+            std::string format = samples.value("format", "auto");
+            if (format == "auto") audio.samples.format = SampleFormat::AUTO;
+            else if (format == "f32") audio.samples.format = SampleFormat::F32;
+            else if (format == "int16") audio.samples.format = SampleFormat::INT16;
+            else std::cerr << "Unknown samples.format: " << format << ", using \"auto\"" << std::endl;
+        }
+        
+        std::string stealing = audio_json.value("voice_stealing", "fading");
+        if (stealing == "none") audio.voiceStealing = VoiceStealPolicy::NONE;
+        else if (stealing == "oldest") audio.voiceStealing = VoiceStealPolicy::OLDEST;
+        else if (stealing == "quietest") audio.voiceStealing = VoiceStealPolicy::QUIETEST;
+        else if (stealing == "fading") audio.voiceStealing = VoiceStealPolicy::FADING_FIRST;
+        else if (stealing == "same_key") audio.voiceStealing = VoiceStealPolicy::SAME_KEY_FIRST;
+        else std::cerr << "Unknown voice_stealing policy: " << stealing << ", using \"fading\"" << std::endl;
         
         // Audio effects config
         if (audio_json.contains("effects")) {
@@ -178,12 +467,65 @@ void Config::parseFromJson(const nlohmann::json& j) {
             audio.effects.enableEcho = effects.value("enable_echo", false);
             audio.effects.echoDelay = effects.value("echo_delay", 0.3f);
             audio.effects.echoDecay = effects.value("echo_decay", 0.4f);
-            audio.effects.echoTaps = effects.value("echo_taps", 3);
+            audio.effects.echoTapList.clear();
+            if (effects.contains("echo_taps") && effects["echo_taps"].is_array()) {
+                // [{"delay": 0.1, "gain": 0.5}, ...] places each repeat individually
+                for (const auto& tap : effects["echo_taps"]) {
+                    if (!tap.is_object()) continue;
+                    EchoTapConfig tapConfig;
+                    tapConfig.delay = std::max(0.0f, tap.value("delay", 0.0f));
+                    tapConfig.gain = tap.value("gain", 0.0f);
+                    audio.effects.echoTapList.push_back(tapConfig);
+                }
+            } else {
+                audio.effects.echoTaps = std::min(std::max(effects.value("echo_taps", 3), 1), 64);
+            }
+            audio.effects.echoFeedback = std::min(std::max(effects.value("echo_feedback", 0.0f), 0.0f), 0.95f);
+            audio.effects.echoDamping = std::min(std::max(effects.value("echo_damping", 0.0f), 0.0f), 1.0f);
             
             audio.effects.enableSpatializer = effects.value("enable_spatializer", false);
+            std::string spatialMode = effects.value("spatial_mode", "3d");
+            if (spatialMode == "3d") audio.effects.spatialMode = SpatialMode::FULL_3D;
+            else if (spatialMode == "pan") audio.effects.spatialMode = SpatialMode::PAN;
+            else std::cerr << "Unknown spatial_mode: " << spatialMode << ", using \"3d\"" << std::endl;
             audio.effects.randomSpatialPosition = effects.value("random_spatial_position", true);
+            std::string keyboardLayout = effects.value("keyboard_layout", "none");
+            if (keyboardLayout == "none") audio.effects.keyboardLayout = KeyboardLayout::NONE;
+            else if (keyboardLayout == "ansi") audio.effects.keyboardLayout = KeyboardLayout::ANSI;
+            else if (keyboardLayout == "iso") audio.effects.keyboardLayout = KeyboardLayout::ISO;
+            else std::cerr << "Unknown keyboard_layout: " << keyboardLayout << ", using \"none\"" << std::endl;
             audio.effects.spatialSpread = effects.value("spatial_spread", 2.0f);
             audio.effects.listenerDistance = effects.value("listener_distance", 1.0f);
+            
+            audio.effects.keyboardSends.dry = effects.value("keyboard_dry_send", 0.0f);
+            audio.effects.keyboardSends.wet = effects.value("keyboard_wet_send", 1.0f);
+            audio.effects.mouseSends.dry = effects.value("mouse_dry_send", 0.0f);
+            audio.effects.mouseSends.wet = effects.value("mouse_wet_send", 1.0f);
         }
+        
+        // Output device and buffering
+        if (audio_json.contains("latency")) {
+            auto& latency = audio_json["latency"];
+            audio.latency.periodFrames = latency.value("period_frames", 0);
+            audio.latency.periodMs = latency.value("period_ms", 0);
+            audio.latency.periods = latency.value("periods", 0);
+            audio.latency.exclusiveMode = latency.value("exclusive_mode", false);
+            audio.latency.device = latency.value("device", "");
+            
+            if (latency.contains("backends")) {
+                for (const auto& backend : latency["backends"]) {
+                    if (backend.is_string()) {
+                        audio.latency.backends.push_back(backend.get<std::string>());
+                    }
+                }
+            }
+        }
+    }
+    
+    // Hot reload config
+    if (j.contains("hot_reload")) {
+        auto& hot_reload_json = j["hot_reload"];
+        hotReload.debounceMs = std::max(0, hot_reload_json.value("debounce_ms", 200));
+        hotReload.watchSounds = hot_reload_json.value("watch_sounds", true);
     }
 }
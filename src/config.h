@@ -1,8 +1,8 @@
 #pragma once
 #include <string>
 #include <vector>
-#include <unordered_set>
 #include "nlohmann/json.hpp"
+#include "key_state.h"
 
 struct MouseConfig {
     bool enabled = true;
@@ -15,10 +15,31 @@ struct MouseConfig {
     bool enableSideButtons = false;
     bool enableFadeOut = false;
     int fadeOutDurationMs = 50;
+    int attackMs = 0; // Fade-in at the start of each sound, 0 = start at full volume
     int scrollWheelDebounceMs = 50;
     float volume = 1.0f; // 0.0 to 1.0
 };
 
+// How a keyboard.key_sounds set picks its next sample
+enum class KeySoundOrder {
+    RANDOM,     // Any sample but the one played last
+    ROUND_ROBIN // Each sample in turn
+};
+
+// The samples a key sound set plays from a given typing speed up
+struct KeySoundLayer {
+    float minKeysPerSecond = 0.0f;
+    std::vector<std::string> sounds;
+};
+
+// A keyboard.key_sounds entry: its own samples for one key or a group of keys
+struct KeySoundSet {
+    std::string name; // Key or group name it was configured under
+    KeySet keys;
+    KeySoundOrder order = KeySoundOrder::RANDOM;
+    std::vector<KeySoundLayer> layers; // Ascending minKeysPerSecond, the first one covers any speed below it
+};
+
 struct KeyboardConfig {
     bool enabled = true;
     std::string soundsDir;
@@ -27,13 +48,37 @@ struct KeyboardConfig {
     bool disableRepeat = false;
     bool enableFadeOut = false;
     int fadeOutDurationMs = 50;
+    int attackMs = 0; // Fade-in at the start of each sound, 0 = start at full volume
     int keyRepeatDebounceMs = 50;
     float volume = 1.0f; // 0.0 to 1.0
-    std::unordered_set<int> noRepeatKeys;
+    KeySet noRepeatKeys;
     std::vector<std::string> sounds;
-    std::unordered_set<int> excludedKeys;
+    KeySet excludedKeys;
+    std::vector<KeySoundSet> keySounds; // Keys without a set play from sounds. Groups come first, single keys override them
+};
+
+// How much of a sound category reaches the output directly (dry) and through the effects chain (wet).
+// The chain applies its own reverb_wetness mix on top of the wet send
+struct EffectSends {
+    float dry = 0.0f;
+    float wet = 1.0f;
+};
+
+// One repeat in an explicit echo pattern
+struct EchoTapConfig {
+    float delay = 0.0f; // Seconds after the original sound
+    float gain = 0.0f;
+};
+
+// How enable_spatializer places sounds
+enum class SpatialMode {
+    FULL_3D, // miniaudio's spatializer on every voice: distance, direction and doppler, every block
+    PAN      // A constant-power stereo pan worked out once when the sound starts
 };
 
+// Physical keyboard used to place keyboard sounds where their keys are
+enum class KeyboardLayout { NONE, ANSI, ISO };
+
 struct AudioEffectsConfig {
     bool enableReverb = false;
     float reverbWetness = 0.3f;        // 0.0 = dry, 1.0 = fully wet
@@ -45,36 +90,127 @@ struct AudioEffectsConfig {
     bool enableEcho = false;
     float echoDelay = 0.3f;            // Echo delay in seconds
     float echoDecay = 0.4f;            // Echo volume decay (0.0-1.0)
-    int echoTaps = 3;                  // Number of echo repetitions
+    int echoTaps = 3;                  // Number of echo repetitions, echoDelay apart, each echoDecay times the last
+    std::vector<EchoTapConfig> echoTapList; // Explicit repetitions instead, when echo_taps is a list
+    float echoFeedback = 0.0f;         // Repeats the whole pattern after its last tap (0.0-0.95)
+    float echoDamping = 0.0f;          // High frequency loss on each repeat of the pattern (0.0-1.0)
     
     bool enableSpatializer = false;
+    SpatialMode spatialMode = SpatialMode::FULL_3D;
     bool randomSpatialPosition = true; // Randomize 3D position for each sound
+    KeyboardLayout keyboardLayout = KeyboardLayout::NONE; // Keyboard sounds come from their key's position instead
     float spatialSpread = 2.0f;        // How wide the spatial field is
     float listenerDistance = 1.0f;    // Distance from listener to sound field
+    
+    EffectSends keyboardSends;
+    EffectSends mouseSends;
+};
+
+// Which playing voice gives way when a new sound would exceed max_concurrent_sounds
+enum class VoiceStealPolicy {
+    NONE,           // Drop the new sound instead
+    OLDEST,         // The voice that started first
+    QUIETEST,       // The voice with the lowest current output level
+    FADING_FIRST,   // A voice that is already fading out, otherwise the oldest
+    SAME_KEY_FIRST  // A voice started by the same key or button, otherwise the oldest
+};
+
+// Output device setup. Every field left at its default keeps miniaudio's choice. Applied at startup
+struct AudioLatencyConfig {
+    int periodFrames = 0;              // Frames per device callback, takes precedence over periodMs
+    int periodMs = 0;                  // Callback period in milliseconds
+    int periods = 0;                   // Number of periods in the device buffer
+    bool exclusiveMode = false;        // Bypass the system mixer where the backend supports it (e.g. WASAPI)
+    std::vector<std::string> backends; // Backends to try in order, e.g. "wasapi", "alsa", "pulseaudio"
+    std::string device;                // Playback device name (or part of it), empty = system default
+};
+
+enum class SampleFormat {
+    AUTO,  // int16 when the decoded PCM fits it exactly (16-bit sources at the output rate), else f32
+    F32,
+    INT16
+};
+
+// How sounds are prepared when they're loaded into the sample cache
+struct SampleLoadConfig {
+    bool trimSilence = true;
+    float trimThresholdDb = -60.0f; // Leading silence and the tail below this level (dBFS) are cut off
+    SampleFormat format = SampleFormat::AUTO;
+    // Bring every sample to the same loudness, so random picks from a directory play at an even level
+    bool normalizeLoudness = false;
+    float targetLoudnessDb = -30.0f; // RMS of the audible part, dBFS
+};
+
+// Watching config.json and the sound directories for changes while running
+struct HotReloadConfig {
+    int debounceMs = 200;   // Changes are applied once files have been quiet this long
+    bool watchSounds = true; // Sound files added, removed or rewritten in the sound directories are picked up
 };
 
 struct AudioConfig {
     bool asyncPlayback = true;
+    std::string soundPack; // Packed samples made with clicksounds-pack, empty = decode the sound files
+    SampleLoadConfig samples;
     int maxConcurrentSounds = 32;
     float masterVolume = 1.0f; // 0.0 to 1.0 - overall volume control
+    VoiceStealPolicy voiceStealing = VoiceStealPolicy::FADING_FIRST;
     AudioEffectsConfig effects;
+    AudioLatencyConfig latency;
+};
+
+// What a reload changed, so each part of the app only redoes its own share. Volumes are listed
+// apart from the rest of their section since applying one is just storing the new value
+struct ConfigDiff {
+    bool mouse = false;          // Any mouse setting other than volume
+    bool keyboard = false;       // Any keyboard setting other than volume
+    bool mouseVolume = false;
+    bool keyboardVolume = false;
+    bool keyboardSounds = false; // keyboard.sounds resolves to other files, or the same ones in another order
+    bool keySounds = false;      // keyboard.key_sounds
+    bool soundFiles = false;     // getSoundFiles() lists other files
+    bool masterVolume = false;
+    bool maxConcurrentSounds = false;
+    bool voiceStealing = false;
+    bool effects = false;
+    bool soundPack = false;
+    bool samples = false;
+    bool latency = false;        // Only takes effect on restart
+    bool audio = false;          // Any other audio setting
+    bool hotReload = false;
+    
+    bool any() const;
+    std::string describe() const; // Changed parts for the log, e.g. "keyboard volume, effects"
 };
 
 struct Config {
     MouseConfig mouse;
     KeyboardConfig keyboard;
     AudioConfig audio;
+    HotReloadConfig hotReload;
     
     static Config loadFromFile(const std::string& filepath);
     
-    // Reload config from the same file path
-    bool reload();
+    // Reload config from the same file path. Only the settings that changed are written, and diff
+    // says which those were. A file that fails to parse leaves everything as it was
+    bool reload(ConfigDiff& diff);
     
     // Get the file path used to load this config
     const std::string& getFilePath() const { return filepath_; }
     
+    // Every sound file referenced by the mouse and keyboard sections, without duplicates
+    std::vector<std::string> getSoundFiles() const;
+    
+    // The directories those files are in, plus the keyboard's sounds_dir, without duplicates
+    std::vector<std::string> getSoundDirectories() const;
+    
+    // Whether the file has one of the extensions loaded from sound directories
+    static bool isSoundFile(const std::string& filepath);
+
 private:
     static std::vector<std::string> loadSoundsFromDirectory(const std::string& dir);
+    static std::vector<std::string> loadKeySoundFiles(const nlohmann::json& j, const std::string& keyboardDir);
     void parseFromJson(const nlohmann::json& j);
+    ConfigDiff diff(const Config& next, const nlohmann::json& nextJson) const;
     std::string filepath_; // Store the file path for reloading
+    nlohmann::json json_; // The document the settings were parsed from, to diff against on reload
 };
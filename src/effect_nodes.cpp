@@ -0,0 +1,308 @@
+#include "effect_nodes.h"
+#include <algorithm>
+#include <cmath>
+
+// Parameter changes glide over roughly this long
+static const float kParamSmoothMs = 20.0f;
+
+// The reverb goes idle once input and output have stayed under -80 dBFS (verblib's own silence
+// threshold) for this long. verblib's denormal guard quantizes the comb state, so the tail settles
+// into a limit cycle around -95 dBFS instead of decaying to zero
+static const float kIdleThreshold = 1e-4f;
+static const float kIdleHoldMs = 100.0f;
+
+// One-pole step for a block: the fraction of the remaining distance to cover in frameCount frames
+static float smoothing_step(ma_uint32 frameCount, ma_uint32 sampleRate) {
+    float tau = kParamSmoothMs * 0.001f * static_cast<float>(sampleRate);
+    return 1.0f - std::exp(-static_cast<float>(frameCount) / tau);
+}
+
+// Moves value towards target, snapping once the difference is inaudible. Returns true if it changed
+static bool glide(float& value, float target, float step) {
+    if (value == target) return false;
+    value += (target - value) * step;
+    if (std::fabs(target - value) < 1e-4f) value = target;
+    return true;
+}
+
+static bool is_silent(const float* samples, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (std::fabs(samples[i]) >= kIdleThreshold) return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------
+
+ma_node_vtable ReverbNode::vtable_ = {
+    &ReverbNode::process,
+    nullptr,
+    1, // 1 input bus
+    1, // 1 output bus
+    MA_NODE_FLAG_CONTINUOUS_PROCESSING // Keep processing after the input goes quiet so the tail rings out
+};
+
+ReverbNode::~ReverbNode() {
+    uninit();
+}
+
+ma_result ReverbNode::init(ma_node_graph* graph, ma_uint32 channels, ma_uint32 sampleRate, const ReverbParams& params) {
+    if (!verblib_initialize(&reverb_, sampleRate, channels)) {
+        return MA_INVALID_ARGS;
+    }
+    
+    channels_ = channels;
+    sampleRate_ = sampleRate;
+    kernel_ = ReverbKernel::best();
+    idleHoldFrames_ = static_cast<ma_uint32>(kIdleHoldMs * 0.001f * sampleRate);
+    quietFrames_ = 0;
+    idle_.store(false, std::memory_order_relaxed);
+    target_ = current_ = params;
+    pending_.reset(params);
+    apply(params);
+    
+    ma_node_config nodeConfig = ma_node_config_init();
+    nodeConfig.vtable = &vtable_;
+    nodeConfig.pInputChannels = &channels;
+    nodeConfig.pOutputChannels = &channels;
+    
+    node_.owner = this;
+    ma_result result = ma_node_init(graph, &nodeConfig, nullptr, &node_.base);
+    initialized_ = result == MA_SUCCESS;
+    return result;
+}
+
+void ReverbNode::uninit() {
+    if (initialized_) {
+        ma_node_uninit(&node_.base, nullptr);
+        initialized_ = false;
+    }
+}
+
+void ReverbNode::setParams(const ReverbParams& params) {
+    pending_.write(params);
+}
+
+void ReverbNode::apply(const ReverbParams& params) {
+    verblib_set_room_size(&reverb_, params.roomSize);
+    verblib_set_damping(&reverb_, params.damping);
+    verblib_set_width(&reverb_, params.width);
+    verblib_set_wet(&reverb_, params.wet);
+    verblib_set_dry(&reverb_, params.dry);
+}
+
+void ReverbNode::process(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut) {
+    (void)pFrameCountIn;
+    ReverbNode* self = static_cast<Node*>(pNode)->owner;
+    ma_uint32 frameCount = *pFrameCountOut;
+    
+    self->pending_.read(self->target_);
+    
+    float step = smoothing_step(frameCount, self->sampleRate_);
+    bool changed = false;
+    changed |= glide(self->current_.wet, self->target_.wet, step);
+    changed |= glide(self->current_.dry, self->target_.dry, step);
+    changed |= glide(self->current_.roomSize, self->target_.roomSize, step);
+    changed |= glide(self->current_.damping, self->target_.damping, step);
+    changed |= glide(self->current_.width, self->target_.width, step);
+    if (changed) {
+        self->apply(self->current_);
+    }
+    
+    // Idle: the tail is gone, so the whole comb/allpass bank would only be computing silence. What
+    // is left in its delay lines is below the threshold and can't be heard when it wakes up
+    size_t sampleCount = static_cast<size_t>(frameCount) * self->channels_;
+    bool inputSilent = is_silent(ppFramesIn[0], sampleCount);
+    if (self->idle_.load(std::memory_order_relaxed)) {
+        if (inputSilent) {
+            std::fill(ppFramesOut[0], ppFramesOut[0] + sampleCount, 0.0f);
+            return;
+        }
+        self->idle_.store(false, std::memory_order_relaxed);
+        self->quietFrames_ = 0;
+    }
+    
+    ReverbKernel::process(self->kernel_, &self->reverb_, ppFramesIn[0], ppFramesOut[0], frameCount);
+    
+    if (!self->idleBypass_) return;
+    if (inputSilent && is_silent(ppFramesOut[0], sampleCount)) {
+        self->quietFrames_ += frameCount;
+        if (self->quietFrames_ >= self->idleHoldFrames_) {
+            self->idle_.store(true, std::memory_order_relaxed);
+        }
+    } else {
+        self->quietFrames_ = 0;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+
+ma_node_vtable EchoNode::vtable_ = {
+    &EchoNode::process,
+    nullptr,
+    1,
+    1,
+    MA_NODE_FLAG_CONTINUOUS_PROCESSING // The repeats continue after the input stops
+};
+
+// Position delay frames behind cursor in a ring of length frames (delay <= length)
+static ma_uint32 ring_offset(ma_uint32 cursor, ma_uint32 delay, ma_uint32 length) {
+    return cursor >= delay ? cursor - delay : cursor + length - delay;
+}
+
+// Recursive sums and the feedback filter would otherwise decay into denormals after every sound
+static float flush_denormal(float value) {
+    return std::fabs(value) < 1e-20f ? 0.0f : value;
+}
+
+EchoNode::~EchoNode() {
+    uninit();
+}
+
+ma_result EchoNode::init(ma_node_graph* graph, ma_uint32 channels, ma_uint32 sampleRate, const EchoLayout& layout, const EchoParams& params) {
+    if (channels == 0) {
+        return MA_INVALID_ARGS;
+    }
+    
+    layout_ = layout;
+    if (layout_.taps.empty()) {
+        if (layout_.spacingFrames == 0 || layout_.tapCount == 0) {
+            return MA_INVALID_ARGS;
+        }
+        // One period longer than the last tap, for the term leaving the recursive sum
+        lastTapFrames_ = layout_.spacingFrames * layout_.tapCount;
+        lengthFrames_ = lastTapFrames_ + layout_.spacingFrames;
+    } else {
+        lastTapFrames_ = 0;
+        for (const EchoTap& tap : layout_.taps) {
+            if (tap.delayFrames == 0) {
+                return MA_INVALID_ARGS;
+            }
+            lastTapFrames_ = std::max(lastTapFrames_, tap.delayFrames);
+        }
+        lengthFrames_ = lastTapFrames_;
+    }
+    
+    channels_ = channels;
+    sampleRate_ = sampleRate;
+    cursor_ = 0;
+    sumCursor_ = 0;
+    history_.assign(static_cast<size_t>(lengthFrames_) * channels, 0.0f);
+    sums_.assign(layout_.taps.empty() ? static_cast<size_t>(layout_.spacingFrames) * channels : 0, 0.0f);
+    filter_.assign(channels, 0.0f);
+    target_ = current_ = params;
+    decayPower_ = std::pow(current_.decay, static_cast<float>(layout_.tapCount + 1));
+    pending_.reset(params);
+    
+    ma_node_config nodeConfig = ma_node_config_init();
+    nodeConfig.vtable = &vtable_;
+    nodeConfig.pInputChannels = &channels;
+    nodeConfig.pOutputChannels = &channels;
+    
+    node_.owner = this;
+    ma_result result = ma_node_init(graph, &nodeConfig, nullptr, &node_.base);
+    initialized_ = result == MA_SUCCESS;
+    return result;
+}
+
+void EchoNode::uninit() {
+    if (initialized_) {
+        ma_node_uninit(&node_.base, nullptr);
+        initialized_ = false;
+    }
+}
+
+void EchoNode::setParams(const EchoParams& params) {
+    pending_.write(params);
+}
+
+// The recursion only holds while decay stays put. When it moves, the last period of sums is
+// recomputed from the delay line with the new decay, which costs spacing * tapCount once
+void EchoNode::rebuildSums() {
+    const ma_uint32 channels = channels_;
+    const ma_uint32 spacing = layout_.spacingFrames;
+    const float decay = current_.decay;
+    decayPower_ = std::pow(decay, static_cast<float>(layout_.tapCount + 1));
+    
+    for (ma_uint32 age = 1; age <= spacing; age++) {
+        float* sum = sums_.data() + ring_offset(sumCursor_, age, spacing) * channels;
+        for (ma_uint32 c = 0; c < channels; c++) {
+            // Horner form of decay * line[t - spacing] + decay^2 * line[t - 2 * spacing] + ...
+            float acc = 0.0f;
+            for (ma_uint32 k = layout_.tapCount; k >= 1; k--) {
+                acc = decay * (acc + history_[ring_offset(cursor_, age + k * spacing, lengthFrames_) * channels + c]);
+            }
+            sum[c] = flush_denormal(acc);
+        }
+    }
+}
+
+void EchoNode::process(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut) {
+    (void)pFrameCountIn;
+    EchoNode* self = static_cast<Node*>(pNode)->owner;
+    const float* in = ppFramesIn[0];
+    float* out = ppFramesOut[0];
+    ma_uint32 frameCount = *pFrameCountOut;
+    const ma_uint32 channels = self->channels_;
+    
+    EchoParams params;
+    if (self->pending_.read(params)) {
+        self->target_ = params;
+    }
+    
+    // Feedback ramps linearly across the block towards where the glide ends up. Damping and the
+    // tap decay move once per block
+    float step = smoothing_step(frameCount, self->sampleRate_);
+    float feedback = self->current_.feedback;
+    glide(self->current_.feedback, self->target_.feedback, step);
+    float feedbackStep = frameCount > 0 ? (self->current_.feedback - feedback) / static_cast<float>(frameCount) : 0.0f;
+    glide(self->current_.damping, self->target_.damping, step);
+    const float smoothing = 1.0f - std::min(std::max(self->current_.damping, 0.0f), 1.0f);
+    
+    const bool evenlySpaced = self->layout_.taps.empty();
+    if (evenlySpaced && glide(self->current_.decay, self->target_.decay, step)) {
+        self->rebuildSums();
+    }
+    
+    float* history = self->history_.data();
+    float* filter = self->filter_.data();
+    const ma_uint32 length = self->lengthFrames_;
+    ma_uint32 cursor = self->cursor_;
+    
+    for (ma_uint32 frame = 0; frame < frameCount; frame++) {
+        feedback += feedbackStep;
+        float* slot = history + cursor * channels; // Holds the oldest frame until it's overwritten below
+        const float* last = history + ring_offset(cursor, self->lastTapFrames_, length) * channels;
+        
+        if (evenlySpaced) {
+            const float decay = self->current_.decay;
+            const float* spaced = history + ring_offset(cursor, self->layout_.spacingFrames, length) * channels;
+            float* sum = self->sums_.data() + self->sumCursor_ * channels;
+            for (ma_uint32 c = 0; c < channels; c++) {
+                sum[c] = flush_denormal(decay * (spaced[c] + sum[c]) - self->decayPower_ * slot[c]);
+                out[c] = in[c] + sum[c];
+            }
+            if (++self->sumCursor_ == self->layout_.spacingFrames) self->sumCursor_ = 0;
+        } else {
+            for (ma_uint32 c = 0; c < channels; c++) {
+                out[c] = in[c];
+            }
+            for (const EchoTap& tap : self->layout_.taps) {
+                const float* tapped = history + ring_offset(cursor, tap.delayFrames, length) * channels;
+                for (ma_uint32 c = 0; c < channels; c++) {
+                    out[c] += tap.gain * tapped[c];
+                }
+            }
+        }
+        
+        for (ma_uint32 c = 0; c < channels; c++) {
+            filter[c] = flush_denormal(filter[c] + (last[c] - filter[c]) * smoothing);
+            slot[c] = in[c] + feedback * filter[c];
+        }
+        in += channels;
+        out += channels;
+        if (++cursor == length) cursor = 0;
+    }
+    
+    self->cursor_ = cursor;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include "miniaudio/miniaudio.h"
+#include "miniaudio/verblib.h"
+#include "triple_buffer.h"
+#include "reverb_kernel.h"
+
+// Settings an effect can change while it runs. The control thread publishes a whole block at once
+// and the audio thread glides towards it, so edits never click. Anything not in here (whether an
+// effect exists, where the echo taps are) is fixed at creation and changes by building a new chain.
+struct ReverbParams {
+    float wet = 0.2f;       // verblib levels, before verblib's own wet/dry scaling
+    float dry = 0.7f;
+    float roomSize = 0.5f;
+    float damping = 0.5f;
+    float width = 1.0f;
+};
+
+struct EchoParams {
+    float decay = 0.4f;     // Gain ratio between evenly spaced taps
+    float feedback = 0.0f;  // How much of the last tap goes back into the delay line
+    float damping = 0.0f;   // Low-pass on the feedback path, 0 = none
+};
+
+struct EchoTap {
+    ma_uint32 delayFrames = 0;
+    float gain = 0.0f;
+    
+    bool operator==(const EchoTap& other) const { return delayFrames == other.delayFrames && gain == other.gain; }
+};
+
+// Where an echo's taps are. Fixed at creation, like the delay line it sizes
+struct EchoLayout {
+    // tapCount evenly spaced taps: tap k at k * spacingFrames with gain decay^k
+    ma_uint32 spacingFrames = 0;
+    ma_uint32 tapCount = 0;
+    // Taps with their own delays and fixed gains, used instead when not empty
+    std::vector<EchoTap> taps;
+    
+    bool operator==(const EchoLayout& other) const {
+        return spacingFrames == other.spacingFrames && tapCount == other.tapCount && taps == other.taps;
+    }
+};
+
+// Freeverb (verblib) as a node. Replaces ma_reverb_node so parameters can change in place.
+// Once the input is silent and the tail has decayed below audibility it stops running the comb
+// bank and outputs silence, and it wakes on the first block with input again
+class ReverbNode {
+public:
+    ~ReverbNode();
+    
+    ma_result init(ma_node_graph* graph, ma_uint32 channels, ma_uint32 sampleRate, const ReverbParams& params);
+    void uninit();
+    
+    // Any thread, but only one at a time
+    void setParams(const ReverbParams& params);
+    
+    // On by default. Only meant to be changed before the node is processed, for benchmarking
+    void setIdleBypass(bool enabled) { idleBypass_ = enabled; }
+    bool isIdle() const { return idle_.load(std::memory_order_relaxed); }
+    
+    ma_node* node() { return &node_.base; }
+
+private:
+    struct Node {
+        ma_node_base base; // Must be first
+        ReverbNode* owner;
+    };
+    
+    static void process(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut);
+    static ma_node_vtable vtable_;
+    void apply(const ReverbParams& params);
+    
+    Node node_{};
+    bool initialized_ = false;
+    ma_uint32 channels_ = 2;
+    ma_uint32 sampleRate_ = 48000;
+    verblib reverb_;
+    ReverbKernel::Kind kernel_ = ReverbKernel::SCALAR;
+    bool idleBypass_ = true;
+    std::atomic<bool> idle_{false};
+    ma_uint32 quietFrames_ = 0;     // Audio thread only: how long input and output have both been silent
+    ma_uint32 idleHoldFrames_ = 0;
+    TripleBuffer<ReverbParams> pending_;
+    ReverbParams target_;   // Audio thread only
+    ReverbParams current_;  // Audio thread only
+};
+
+// Multi-tap delay. All taps read one shared delay line, and the output is the input plus every tap.
+// Evenly spaced taps form a geometric series, which is computed recursively from the previous
+// period's sum (sum[n] = decay * (line[n - spacing] + sum[n - spacing]) - decay^(N+1) *
+// line[n - (N+1) * spacing]), so the work per frame is the same for any tap count. Explicit taps
+// cost one multiply-add each. Feedback returns the last tap to the delay line, through a one-pole
+// low-pass, so the whole pattern repeats and darkens
+class EchoNode {
+public:
+    ~EchoNode();
+    
+    ma_result init(ma_node_graph* graph, ma_uint32 channels, ma_uint32 sampleRate, const EchoLayout& layout, const EchoParams& params);
+    void uninit();
+    
+    // Any thread, but only one at a time
+    void setParams(const EchoParams& params);
+    
+    ma_node* node() { return &node_.base; }
+
+private:
+    struct Node {
+        ma_node_base base; // Must be first
+        EchoNode* owner;
+    };
+    
+    static void process(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut);
+    static ma_node_vtable vtable_;
+    void rebuildSums();
+    
+    Node node_{};
+    bool initialized_ = false;
+    ma_uint32 channels_ = 2;
+    ma_uint32 sampleRate_ = 48000;
+    EchoLayout layout_;
+    ma_uint32 lastTapFrames_ = 0;   // Delay of the last tap, where feedback is taken from
+    std::vector<float> history_;    // The delay line, lengthFrames_ of interleaved input and feedback
+    ma_uint32 lengthFrames_ = 0;
+    ma_uint32 cursor_ = 0;
+    std::vector<float> sums_;       // Evenly spaced taps: the last spacingFrames of tap sums
+    ma_uint32 sumCursor_ = 0;
+    std::vector<float> filter_;     // Feedback low-pass state per channel
+    float decayPower_ = 0.0f;       // decay^(tapCount + 1)
+    TripleBuffer<EchoParams> pending_;
+    EchoParams target_;   // Audio thread only
+    EchoParams current_;  // Audio thread only
+};
@@ -1,6 +1,91 @@
 #include "file_watcher.h"
+#include "config.h"
+#include <algorithm>
 #include <iostream>
 
+#ifdef PLATFORM_LINUX
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace fs = std::filesystem;
+
+// How often directories without a DirectoryWatch are looked at
+static const std::chrono::milliseconds kPollInterval(1000);
+
+#ifdef PLATFORM_LINUX
+bool DirectoryWatch::start(const std::string& directory, std::function<void()> callback) {
+    callback_ = std::move(callback);
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    // IN_MOVED_TO is a file renamed over another one, or in from elsewhere
+    const uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+    if (inotifyFd_ < 0 || wakeFd_ < 0 || inotify_add_watch(inotifyFd_, directory.c_str(), mask) < 0) {
+        std::cerr << "Failed to watch " << directory << ", polling it instead: " << strerror(errno) << std::endl;
+        return false;
+    }
+    thread_ = std::thread(&DirectoryWatch::run, this);
+    return true;
+}
+
+DirectoryWatch::~DirectoryWatch() {
+    if (thread_.joinable()) {
+        uint64_t one = 1;
+        ssize_t written = write(wakeFd_, &one, sizeof(one));
+        (void)written;
+        thread_.join();
+    }
+    if (inotifyFd_ >= 0) close(inotifyFd_);
+    if (wakeFd_ >= 0) close(wakeFd_);
+}
+
+void DirectoryWatch::run() {
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = {{inotifyFd_, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        
+        // Which files the events name doesn't matter, only that there were some
+        bool changed = false;
+        while (read(inotifyFd_, buffer, sizeof(buffer)) > 0) {
+            changed = true;
+        }
+        if (changed) callback_();
+    }
+}
+#endif
+
+#ifdef PLATFORM_WINDOWS
+bool DirectoryWatch::start(const std::string& directory, std::function<void()> callback) {
+    try {
+        watch_ = std::make_unique<filewatch::FileWatch<std::string>>(
+            directory,
+            [callback](const std::string&, const filewatch::Event) {
+                callback();
+            }
+        );
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to watch " << directory << ", polling it instead: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+DirectoryWatch::~DirectoryWatch() = default;
+#endif
+
+bool FileWatcher::Stamp::operator!=(const Stamp& other) const {
+    return exists != other.exists || size != other.size || modified != other.modified;
+}
+
 FileWatcher::FileWatcher() : watching_(false) {
 }
 
@@ -8,41 +93,196 @@ FileWatcher::~FileWatcher() {
     stopWatching();
 }
 
+FileWatcher::Stamp FileWatcher::stampOf(const std::string& filepath) {
+    Stamp stamp;
+    std::error_code error;
+    stamp.size = fs::file_size(filepath, error);
+    if (error) return Stamp{};
+    stamp.modified = fs::last_write_time(filepath, error);
+    if (error) return Stamp{};
+    stamp.exists = true;
+    return stamp;
+}
+
+FileWatcher::Snapshot FileWatcher::scan(const std::string& directory) {
+    Snapshot files;
+    std::error_code error;
+    for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        if (it->is_regular_file(error) && Config::isSoundFile(it->path().string())) {
+            files[it->path().string()] = stampOf(it->path().string());
+        }
+    }
+    return files;
+}
+
+std::unique_ptr<DirectoryWatch> FileWatcher::watchDirectory(const std::string& directory) {
+    // Any event in the directory just means "look again"; the stamps decide what changed
+    auto watch = std::make_unique<DirectoryWatch>();
+    if (!watch->start(directory, [this]() { notify(); })) return nullptr;
+    return watch;
+}
+
+void FileWatcher::updatePolling() {
+    bool polling = !watcher_;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        for (const WatchedDirectory& directory : directories_) {
+            polling = polling || !directory.watcher;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        polling_ = polling;
+    }
+    wake_.notify_one();
+}
+
 bool FileWatcher::watchFile(const std::string& filepath, FileChangedCallback callback) {
     if (watching_) {
         stopWatching();
     }
     
-    try {
-        filepath_ = filepath;
-        callback_ = callback;
+    filepath_ = filepath;
+    callback_ = callback;
+    fileStamp_ = stampOf(filepath);
+    
+    // The directory rather than the file: a save that renames a new file over the old one replaces
+    // the file being watched
+    std::string directory = fs::path(filepath).parent_path().string();
+    watcher_ = watchDirectory(directory.empty() ? "." : directory);
+    
+    stopping_ = false;
+    thread_ = std::thread(&FileWatcher::run, this);
+    watching_ = true;
+    updatePolling();
+    std::cout << "Started watching config file: " << filepath << std::endl;
+    return true;
+}
+
+void FileWatcher::watchDirectories(const std::vector<std::string>& directories, SoundFilesChangedCallback callback) {
+    std::vector<WatchedDirectory> next;
+    std::vector<WatchedDirectory> previous;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        previous = std::move(directories_);
+    }
+    
+    for (const std::string& path : directories) {
+        auto kept = std::find_if(previous.begin(), previous.end(), [&](const WatchedDirectory& d) { return d.path == path; });
+        if (kept != previous.end()) {
+            next.push_back(std::move(*kept));
+            previous.erase(kept);
+            continue;
+        }
+        WatchedDirectory directory;
+        directory.path = path;
+        directory.files = scan(path);
+        directory.watcher = watchDirectory(path);
+        next.push_back(std::move(directory));
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        directories_ = std::move(next);
+        directoriesCallback_ = callback;
+    }
+    
+    // Dropped watchers are destroyed here, outside the lock: their threads may be waiting to notify()
+    previous.clear();
+    updatePolling();
+}
+
+void FileWatcher::setDebounceMs(int debounceMs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    debounceMs_ = std::max(0, debounceMs);
+}
+
+void FileWatcher::notify() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = true;
+        deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(debounceMs_);
+    }
+    wake_.notify_one();
+}
+
+void FileWatcher::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        auto now = std::chrono::steady_clock::now();
+        if (pending_ && now < deadline_) {
+            wake_.wait_until(lock, deadline_); // Every new event pushes the deadline back
+            continue;
+        }
+        if (!pending_ && !polling_) {
+            wake_.wait(lock, [this] { return stopping_ || pending_ || polling_; });
+            continue;
+        }
+        if (!pending_) {
+            if (wake_.wait_for(lock, kPollInterval, [this] { return stopping_ || pending_ || !polling_; })) continue;
+        }
         
-        // Create the file watcher for the specific file
-        watcher_ = std::make_unique<filewatch::FileWatch<std::string>>(
-            filepath,
-            [this](const std::string& path, const filewatch::Event change_type) {
-                // Only trigger on file modifications
-                if (change_type == filewatch::Event::modified) {
-                    if (callback_) {
-                        callback_(path);
-                    }
-                }
-            }
-        );
+        pending_ = false;
+        lock.unlock();
+        check();
+        lock.lock();
+    }
+}
+
+void FileWatcher::check() {
+    bool fileChanged = false;
+    std::vector<std::string> changedSounds;
+    SoundFilesChangedCallback directoriesCallback;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex_);
         
-        watching_ = true;
-        std::cout << "Started watching config file: " << filepath << std::endl;
-        return true;
+        // A file that is missing right now is in the middle of being replaced; the next look sees it
+        Stamp stamp = stampOf(filepath_);
+        if (stamp != fileStamp_) {
+            fileStamp_ = stamp;
+            fileChanged = stamp.exists;
+        }
         
-    } catch (const std::exception& e) {
-        std::cerr << "Failed to start file watcher: " << e.what() << std::endl;
-        return false;
+        for (WatchedDirectory& directory : directories_) {
+            Snapshot files = scan(directory.path);
+            for (const auto& pair : files) {
+                auto it = directory.files.find(pair.first);
+                if (it == directory.files.end() || it->second != pair.second) changedSounds.push_back(pair.first);
+            }
+            for (const auto& pair : directory.files) {
+                if (!files.count(pair.first)) changedSounds.push_back(pair.first);
+            }
+            directory.files = std::move(files);
+        }
+        directoriesCallback = directoriesCallback_;
+    }
+    
+    // Sound changes first: a config reload rescans the directories anyway
+    if (!changedSounds.empty() && directoriesCallback) {
+        directoriesCallback(changedSounds);
+    }
+    if (fileChanged && callback_) {
+        callback_(filepath_);
     }
 }
 
 void FileWatcher::stopWatching() {
     if (watching_) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+        
         watcher_.reset();
+        std::vector<WatchedDirectory> directories;
+        {
+            std::lock_guard<std::mutex> lock(stateMutex_);
+            directories = std::move(directories_);
+            directories_.clear();
+        }
+        directories.clear();
         watching_ = false;
         std::cout << "Stopped watching config file" << std::endl;
     }
@@ -50,4 +290,4 @@ void FileWatcher::stopWatching() {
 
 bool FileWatcher::isWatching() const {
     return watching_;
-}
\ No newline at end of file
+}
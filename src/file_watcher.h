@@ -1,13 +1,60 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <map>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 #include <filesystem>
+
+#ifdef PLATFORM_WINDOWS
 #include "ThomasMonkman/FileWatch.hpp"
+#endif
+
+// Calls back on its own thread whenever something in one directory changes, files renamed in or
+// out included. FileWatch's inotify mask leaves out IN_MOVED_TO, so it never hears of a save that
+// renames a new file over the old one; on Linux this asks inotify itself. FileWatch's Windows
+// backend reports FILE_ACTION_RENAMED_NEW_NAME and is used there
+class DirectoryWatch {
+public:
+    DirectoryWatch() = default;
+    ~DirectoryWatch();
+    DirectoryWatch(const DirectoryWatch&) = delete;
+    DirectoryWatch& operator=(const DirectoryWatch&) = delete;
+    
+    // False, with the reason printed, if the directory can't be watched
+    bool start(const std::string& directory, std::function<void()> callback);
 
+private:
+#ifdef PLATFORM_LINUX
+    void run();
+    
+    std::function<void()> callback_;
+    int inotifyFd_ = -1;
+    int wakeFd_ = -1; // eventfd that stops run()
+    std::thread thread_;
+#endif
+#ifdef PLATFORM_WINDOWS
+    std::unique_ptr<filewatch::FileWatch<std::string>> watch_;
+#endif
+};
+
+// Watches the config file and the sound directories. Change notifications only wake the watcher:
+// once no new one has come in for the debounce window, it compares each file's size and write time
+// with what it saw last and reports what actually changed. That coalesces the several events of one
+// save into a single callback, and catches saves that write a temporary file and rename it over the
+// original, which replace the file without ever modifying it. A directory that can't be watched is
+// polled instead; otherwise the watcher sleeps until something happens.
+//
+// Callbacks run on the watcher's own thread, one at a time
 class FileWatcher {
 public:
     using FileChangedCallback = std::function<void(const std::string& filepath)>;
+    // Sound files, as directory/name, that were added, removed or rewritten
+    using SoundFilesChangedCallback = std::function<void(const std::vector<std::string>& filepaths)>;
     
     FileWatcher();
     ~FileWatcher();
@@ -15,15 +62,61 @@ public:
     // Start watching a file for changes
     bool watchFile(const std::string& filepath, FileChangedCallback callback);
     
+    // Watch these directories for sound files coming, going or changing. Replaces the directories
+    // watched so far; ones that stay keep what they've seen, so a change during the switch isn't lost.
+    // Can be called from a callback
+    void watchDirectories(const std::vector<std::string>& directories, SoundFilesChangedCallback callback);
+    
+    // How long things have to stay quiet before changes are reported
+    void setDebounceMs(int debounceMs);
+    
     // Stop watching the file
     void stopWatching();
     
     // Check if currently watching a file
     bool isWatching() const;
-    
+
 private:
-    std::unique_ptr<filewatch::FileWatch<std::string>> watcher_;
+    struct Stamp {
+        bool exists = false;
+        uintmax_t size = 0;
+        std::filesystem::file_time_type modified;
+        bool operator!=(const Stamp& other) const;
+    };
+    using Snapshot = std::map<std::string, Stamp>; // Sound files of a directory by path
+    
+    struct WatchedDirectory {
+        std::string path;
+        Snapshot files;
+        std::unique_ptr<DirectoryWatch> watcher; // Null if polled
+    };
+    
+    static Stamp stampOf(const std::string& filepath);
+    static Snapshot scan(const std::string& directory);
+    std::unique_ptr<DirectoryWatch> watchDirectory(const std::string& directory);
+    void updatePolling();
+    void notify(); // From the DirectoryWatch threads
+    void run();
+    void check();
+    
+    std::unique_ptr<DirectoryWatch> watcher_; // The config file's directory, null if polled
     FileChangedCallback callback_;
     std::string filepath_;
     bool watching_;
-};
\ No newline at end of file
+    
+    // What was seen at the last check, guarded by stateMutex_
+    std::mutex stateMutex_;
+    Stamp fileStamp_;
+    std::vector<WatchedDirectory> directories_;
+    SoundFilesChangedCallback directoriesCallback_;
+    
+    // Debouncing, guarded by mutex_
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+    bool pending_ = false;
+    bool stopping_ = false;
+    bool polling_ = false; // Some directory has no DirectoryWatch
+    std::chrono::steady_clock::time_point deadline_;
+    int debounceMs_ = 200;
+};
@@ -1,4 +1,10 @@
 #include "input_monitor.h"
+#include <chrono>
+
+uint64_t InputMonitor::nowUs() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
 
 #ifdef PLATFORM_WINDOWS
 #include <windows.h>
@@ -6,13 +12,24 @@
 
 WindowsInputMonitor* WindowsInputMonitor::instance_ = nullptr;
 
-std::unique_ptr<InputMonitor> InputMonitor::create() {
+std::unique_ptr<InputMonitor> InputMonitor::create(const std::vector<std::string>& devicePaths) {
+    // Low-level hooks see every device, so there is nothing to select
+    (void)devicePaths;
     return std::make_unique<WindowsInputMonitor>();
 }
 
 bool WindowsInputMonitor::initialize() {
     instance_ = this;
-    return true;
+    
+    // Auto-reset event the hooks signal after enqueueing
+    wakeEvent_ = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    return wakeEvent_ != nullptr;
+}
+
+WindowsInputMonitor::~WindowsInputMonitor() {
+    if (wakeEvent_) {
+        CloseHandle(wakeEvent_);
+    }
 }
 
 void WindowsInputMonitor::setMouseCallback(MouseCallback callback) {
@@ -23,47 +40,87 @@ void WindowsInputMonitor::setKeyboardCallback(KeyboardCallback callback) {
     keyboardCallback_ = callback;
 }
 
-void WindowsInputMonitor::setUpdateCallback(UpdateCallback callback) {
-    updateCallback_ = callback;
-}
-
 void WindowsInputMonitor::clearCallbacks() {
     mouseCallback_ = nullptr;
     keyboardCallback_ = nullptr;
-    updateCallback_ = nullptr;
+}
+
+InputQueueStats WindowsInputMonitor::getQueueStats() const {
+    InputQueueStats stats;
+    stats.depth = eventQueue_.size();
+    stats.maxDepth = maxQueueDepth_.load(std::memory_order_relaxed);
+    stats.dispatched = dispatchedEvents_.load(std::memory_order_relaxed);
+    stats.overflows = droppedEvents_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void WindowsInputMonitor::enqueue(const InputEvent& event) {
+    // Runs on the hook thread: no locks, no allocation, just a slot write and a wakeup
+    if (!eventQueue_.push(event)) {
+        droppedEvents_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    size_t depth = eventQueue_.size();
+    if (depth > maxQueueDepth_.load(std::memory_order_relaxed)) {
+        maxQueueDepth_.store(depth, std::memory_order_relaxed);
+    }
+    
+    SetEvent(wakeEvent_);
+}
+
+void WindowsInputMonitor::dispatchLoop() {
+    InputEvent event;
+    
+    while (dispatching_.load(std::memory_order_acquire)) {
+        WaitForSingleObject(wakeEvent_, INFINITE);
+        
+        while (eventQueue_.pop(event)) {
+            if (event.type == InputEvent::MOUSE) {
+                if (mouseCallback_) {
+                    mouseCallback_(static_cast<MouseButton>(event.code),
+                                   static_cast<MouseEvent>(event.action), event.timestampUs);
+                }
+            } else if (keyboardCallback_) {
+                keyboardCallback_(event.code, static_cast<KeyEvent>(event.action), event.timestampUs);
+            }
+            dispatchedEvents_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
 }
 
 void WindowsInputMonitor::startMonitoring() {
     running_ = true;
+    hookThreadId_ = GetCurrentThreadId();
+    
+    dispatching_ = true;
+    dispatcherThread_ = std::thread(&WindowsInputMonitor::dispatchLoop, this);
     
     HHOOK mouseHook = SetWindowsHookEx(WH_MOUSE_LL, LowLevelMouseProc, 
                                        GetModuleHandle(nullptr), 0);
     HHOOK keyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, LowLevelKeyboardProc,
                                           GetModuleHandle(nullptr), 0);
     
-    // Set up a timer for regular audio updates (every 10ms)
-    const UINT_PTR TIMER_ID = 1;
-    SetTimer(nullptr, TIMER_ID, 10, nullptr);
-    
+    // Fades run on the audio thread, so this loop only exists to service the hooks and
+    // stays blocked in GetMessage between input events
     MSG msg;
     while (running_ && GetMessage(&msg, nullptr, 0, 0)) {
-        if (msg.message == WM_TIMER && msg.wParam == TIMER_ID) {
-            // Call update callback for audio processing
-            if (updateCallback_) {
-                updateCallback_();
-            }
-        }
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
     
-    KillTimer(nullptr, TIMER_ID);
     UnhookWindowsHookEx(mouseHook);
     UnhookWindowsHookEx(keyboardHook);
+    
+    // Hooks are gone, so nothing else gets queued; let the dispatcher drain and exit
+    dispatching_ = false;
+    SetEvent(wakeEvent_);
+    dispatcherThread_.join();
 }
 
 LRESULT CALLBACK WindowsInputMonitor::LowLevelMouseProc(int nCode, WPARAM wParam, LPARAM lParam) {
     if (nCode >= 0 && instance_ && instance_->mouseCallback_) {
+        uint64_t timestamp = nowUs();
         MouseButton button;
         MouseEvent event;
         bool validEvent = true;
@@ -102,7 +159,12 @@ LRESULT CALLBACK WindowsInputMonitor::LowLevelMouseProc(int nCode, WPARAM wParam
         }
         
         if (validEvent) {
-            instance_->mouseCallback_(button, event);
+            InputEvent queued;
+            queued.timestampUs = timestamp;
+            queued.type = InputEvent::MOUSE;
+            queued.code = static_cast<uint16_t>(button);
+            queued.action = static_cast<uint8_t>(event);
+            instance_->enqueue(queued);
         }
     }
     
@@ -115,14 +177,316 @@ LRESULT CALLBACK WindowsInputMonitor::LowLevelKeyboardProc(int nCode, WPARAM wPa
         KeyEvent event = (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN) ? 
                         KeyEvent::DOWN : KeyEvent::UP;
         
-        instance_->keyboardCallback_(kbd->vkCode, event);
+        InputEvent queued;
+        queued.timestampUs = nowUs();
+        queued.type = InputEvent::KEYBOARD;
+        queued.code = static_cast<uint16_t>(kbd->vkCode);
+        queued.action = static_cast<uint8_t>(event);
+        instance_->enqueue(queued);
     }
     
     return CallNextHookEx(nullptr, nCode, wParam, lParam);
 }
 
 void WindowsInputMonitor::stopMonitoring() {
+    // Without a timer the loop only wakes on messages, and stop may be requested from
+    // another thread (the console control handler), so post the quit to the hook thread itself
+    running_ = false;
+    PostThreadMessage(hookThreadId_, WM_QUIT, 0, 0);
+}
+#endif
+
+#ifdef PLATFORM_LINUX
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+namespace {
+    const char* kInputDir = "/dev/input";
+    
+    bool isEventNode(const char* name) {
+        return strncmp(name, "event", 5) == 0;
+    }
+    
+    bool hasBit(const unsigned long* bits, int bit) {
+        const int bitsPerLong = sizeof(unsigned long) * 8;
+        return (bits[bit / bitsPerLong] >> (bit % bitsPerLong)) & 1;
+    }
+}
+
+std::unique_ptr<InputMonitor> InputMonitor::create(const std::vector<std::string>& devicePaths) {
+    return std::make_unique<LinuxInputMonitor>(devicePaths);
+}
+
+LinuxInputMonitor::LinuxInputMonitor(std::vector<std::string> devicePaths)
+    : devicePaths_(std::move(devicePaths)) {
+}
+
+LinuxInputMonitor::~LinuxInputMonitor() {
+    while (!devices_.empty()) {
+        closeDevice(devices_.begin()->first);
+    }
+    if (inotifyFd_ >= 0) close(inotifyFd_);
+    if (wakeFd_ >= 0) close(wakeFd_);
+    if (epollFd_ >= 0) close(epollFd_);
+}
+
+bool LinuxInputMonitor::initialize() {
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd_ < 0 || wakeFd_ < 0) {
+        std::cerr << "Failed to create epoll/eventfd: " << strerror(errno) << std::endl;
+        return false;
+    }
+    
+    epoll_event wakeEvent{};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.fd = wakeFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &wakeEvent);
+    
+    if (!devicePaths_.empty()) {
+        // Explicit devices only, no hot-plug
+        for (const auto& path : devicePaths_) {
+            openDevice(path, false);
+        }
+    } else {
+        // Watch for devices appearing later. udev fixes up permissions after creating the
+        // node, so IN_ATTRIB is what usually makes a new device readable
+        inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd_ >= 0 && inotify_add_watch(inotifyFd_, kInputDir, IN_CREATE | IN_ATTRIB) >= 0) {
+            epoll_event hotplugEvent{};
+            hotplugEvent.events = EPOLLIN;
+            hotplugEvent.data.fd = inotifyFd_;
+            epoll_ctl(epollFd_, EPOLL_CTL_ADD, inotifyFd_, &hotplugEvent);
+        } else {
+            std::cerr << "Warning: Failed to watch " << kInputDir << " for new devices" << std::endl;
+        }
+        
+        if (DIR* dir = opendir(kInputDir)) {
+            while (dirent* entry = readdir(dir)) {
+                if (isEventNode(entry->d_name)) {
+                    openDevice(std::string(kInputDir) + "/" + entry->d_name, true);
+                }
+            }
+            closedir(dir);
+        }
+    }
+    
+    if (devices_.empty()) {
+        std::cerr << "Warning: No readable input devices. Add your user to the 'input' group "
+                  << "or pass --device with an event node" << std::endl;
+    }
+    
+    return true;
+}
+
+bool LinuxInputMonitor::openDevice(const std::string& path, bool quiet) {
+    for (const auto& pair : devices_) {
+        if (pair.second->path == path) return true;
+    }
+    
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        if (!quiet) {
+            std::cerr << "Failed to open input device " << path << ": " << strerror(errno) << std::endl;
+        }
+        return false;
+    }
+    
+    // Skip devices that can't produce keys, buttons or wheel motion (power buttons still pass,
+    // which is harmless). Anything that isn't an evdev node, such as a pipe, is taken as-is
+    unsigned long eventBits[(EV_MAX + sizeof(unsigned long) * 8) / (sizeof(unsigned long) * 8)] = {};
+    if (ioctl(fd, EVIOCGBIT(0, sizeof(eventBits)), eventBits) >= 0) {
+        if (!hasBit(eventBits, EV_KEY) && !hasBit(eventBits, EV_REL)) {
+            close(fd);
+            return false;
+        }
+        
+        // Ask for monotonic timestamps so event times are on the same clock as InputMonitor::nowUs()
+        int clockId = CLOCK_MONOTONIC;
+        ioctl(fd, EVIOCSCLOCKID, &clockId);
+    }
+    
+    return addDevice(fd, path);
+}
+
+bool LinuxInputMonitor::addDevice(int fd, const std::string& name) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        close(fd);
+        return false;
+    }
+    
+    epoll_event deviceEvent{};
+    deviceEvent.events = EPOLLIN;
+    deviceEvent.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &deviceEvent) < 0) {
+        std::cerr << "Failed to add input device " << name << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    
+    auto device = std::make_unique<Device>();
+    device->path = name;
+    devices_[fd] = std::move(device);
+    std::cout << "Monitoring input device: " << name << std::endl;
+    return true;
+}
+
+void LinuxInputMonitor::closeDevice(int fd) {
+    auto it = devices_.find(fd);
+    if (it == devices_.end()) return;
+    
+    std::cout << "Input device removed: " << it->second->path << std::endl;
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    devices_.erase(it);
+}
+
+void LinuxInputMonitor::setMouseCallback(MouseCallback callback) {
+    mouseCallback_ = callback;
+}
+
+void LinuxInputMonitor::setKeyboardCallback(KeyboardCallback callback) {
+    keyboardCallback_ = callback;
+}
+
+void LinuxInputMonitor::clearCallbacks() {
+    mouseCallback_ = nullptr;
+    keyboardCallback_ = nullptr;
+}
+
+InputQueueStats LinuxInputMonitor::getQueueStats() const {
+    // Events are handled straight off the epoll loop, so there is never a backlog
+    InputQueueStats stats;
+    stats.dispatched = dispatchedEvents_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void LinuxInputMonitor::startMonitoring() {
+    running_ = true;
+    
+    epoll_event ready[16];
+    while (running_) {
+        // No timeout: between input events the process sleeps until a device becomes readable
+        int count = epoll_wait(epollFd_, ready, 16, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            int fd = ready[i].data.fd;
+            if (fd == wakeFd_) {
+                running_ = false;
+            } else if (fd == inotifyFd_) {
+                readHotplug();
+            } else {
+                auto it = devices_.find(fd);
+                if (it != devices_.end()) {
+                    readDevice(fd, *it->second);
+                }
+            }
+        }
+    }
+}
+
+void LinuxInputMonitor::stopMonitoring() {
+    // Only an eventfd write, so this is safe from a signal handler
     running_ = false;
-    PostQuitMessage(0);
+    uint64_t one = 1;
+    if (wakeFd_ >= 0) {
+        ssize_t written = write(wakeFd_, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void LinuxInputMonitor::readDevice(int fd, Device& device) {
+    // A single read per wakeup drains a whole batch of records
+    char* buffer = reinterpret_cast<char*>(device.events.data());
+    const size_t capacity = sizeof(device.events);
+    ssize_t bytes = read(fd, buffer + device.pendingBytes, capacity - device.pendingBytes);
+    
+    if (bytes < 0) {
+        if (errno == EAGAIN || errno == EINTR) return;
+        closeDevice(fd); // ENODEV when unplugged
+        return;
+    }
+    if (bytes == 0) {
+        closeDevice(fd); // Writer side of a pipe closed
+        return;
+    }
+    
+    size_t total = device.pendingBytes + static_cast<size_t>(bytes);
+    size_t count = total / sizeof(input_event);
+    for (size_t i = 0; i < count; i++) {
+        processEvent(device.events[i]);
+    }
+    
+    // Pipes can split a record across reads; keep the tail for next time
+    device.pendingBytes = total - count * sizeof(input_event);
+    if (device.pendingBytes > 0) {
+        memmove(buffer, buffer + count * sizeof(input_event), device.pendingBytes);
+    }
+}
+
+void LinuxInputMonitor::readHotplug() {
+    alignas(inotify_event) char buffer[4096];
+    ssize_t bytes = read(inotifyFd_, buffer, sizeof(buffer));
+    
+    for (ssize_t offset = 0; offset < bytes; ) {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+        if (event->len > 0 && isEventNode(event->name)) {
+            openDevice(std::string(kInputDir) + "/" + event->name, true);
+        }
+        offset += sizeof(inotify_event) + event->len;
+    }
+}
+
+void LinuxInputMonitor::processEvent(const input_event& event) {
+    uint64_t timestamp = static_cast<uint64_t>(event.input_event_sec) * 1000000 + event.input_event_usec;
+    
+    if (event.type == EV_KEY) {
+        // Value 2 is autorepeat, which the app treats like a repeated key down (as on Windows)
+        bool down = event.value != 0;
+        
+        if (event.code >= BTN_MOUSE && event.code < BTN_JOYSTICK) {
+            if (!mouseCallback_) return;
+            
+            MouseButton button;
+            switch (event.code) {
+                case BTN_LEFT: button = MouseButton::LEFT; break;
+                case BTN_RIGHT: button = MouseButton::RIGHT; break;
+                case BTN_MIDDLE: button = MouseButton::MIDDLE; break;
+                case BTN_SIDE: case BTN_BACK: button = MouseButton::X1; break;
+                case BTN_EXTRA: case BTN_FORWARD: button = MouseButton::X2; break;
+                default: return;
+            }
+            if (event.value == 2) return; // Buttons don't autorepeat on Windows either
+            
+            mouseCallback_(button, down ? MouseEvent::BUTTON_DOWN : MouseEvent::BUTTON_UP, timestamp);
+        } else if (event.code < BTN_MISC || event.code >= KEY_OK) {
+            if (!keyboardCallback_) return;
+            keyboardCallback_(event.code, down ? KeyEvent::DOWN : KeyEvent::UP, timestamp);
+        } else {
+            return; // Joystick, gamepad and digitizer buttons
+        }
+    } else if (event.type == EV_REL && event.code == REL_WHEEL) {
+        if (!mouseCallback_ || event.value == 0) return;
+        mouseCallback_(MouseButton::MIDDLE, event.value > 0 ? MouseEvent::WHEEL_UP : MouseEvent::WHEEL_DOWN, timestamp);
+    } else {
+        return;
+    }
+    
+    dispatchedEvents_.fetch_add(1, std::memory_order_relaxed);
 }
-#endif
\ No newline at end of file
+#endif
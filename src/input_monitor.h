@@ -1,31 +1,63 @@
 #pragma once
 #include <functional>
 #include <memory>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include "spsc_queue.h"
+
+#include <string>
+#include <vector>
+#include <array>
 
 #ifdef PLATFORM_WINDOWS
 #include <windows.h>
 #endif
 
+#ifdef PLATFORM_LINUX
+#include <linux/input.h>
+#include <unordered_map>
+#endif
+
 enum class MouseButton { LEFT, RIGHT, MIDDLE, X1, X2 };
 enum class MouseEvent { BUTTON_DOWN, BUTTON_UP, WHEEL_UP, WHEEL_DOWN };
 enum class KeyEvent { DOWN, UP };
 
+// Compact record of one input event, stamped the moment the OS hands it to us
+struct InputEvent {
+    enum Type : uint8_t { KEYBOARD, MOUSE };
+    
+    uint64_t timestampUs = 0; // InputMonitor::nowUs() clock
+    uint16_t code = 0;        // Key code, or MouseButton for mouse events
+    Type type = KEYBOARD;
+    uint8_t action = 0;       // KeyEvent or MouseEvent
+};
+
+struct InputQueueStats {
+    size_t depth = 0;        // Events waiting for the dispatcher right now
+    size_t maxDepth = 0;     // High-water mark since startup
+    uint64_t dispatched = 0;
+    uint64_t overflows = 0;  // Events dropped because the queue was full
+};
+
 class InputMonitor {
 public:
-    using MouseCallback = std::function<void(MouseButton, MouseEvent)>;
-    using KeyboardCallback = std::function<void(int, KeyEvent)>;
-    using UpdateCallback = std::function<void()>;
+    // Timestamps are microseconds on the steady clock
+    using MouseCallback = std::function<void(MouseButton, MouseEvent, uint64_t timestampUs)>;
+    using KeyboardCallback = std::function<void(int, KeyEvent, uint64_t timestampUs)>;
     
-    static std::unique_ptr<InputMonitor> create();
+    // devicePaths selects specific input devices where the backend reads them directly (Linux evdev)
+    static std::unique_ptr<InputMonitor> create(const std::vector<std::string>& devicePaths = {});
+    static uint64_t nowUs();
     virtual ~InputMonitor() = default;
     
     virtual bool initialize() = 0;
     virtual void setMouseCallback(MouseCallback callback) = 0;
     virtual void setKeyboardCallback(KeyboardCallback callback) = 0;
-    virtual void setUpdateCallback(UpdateCallback callback) = 0;
     virtual void clearCallbacks() = 0;
     virtual void startMonitoring() = 0;
     virtual void stopMonitoring() = 0;
+    virtual InputQueueStats getQueueStats() const { return {}; }
 };
 
 #ifdef PLATFORM_WINDOWS
@@ -33,20 +65,78 @@ class WindowsInputMonitor : public InputMonitor {
 private:
     MouseCallback mouseCallback_;
     KeyboardCallback keyboardCallback_;
-    UpdateCallback updateCallback_;
-    bool running_ = false;
+    std::atomic<bool> running_{false};
+    DWORD hookThreadId_ = 0;
     static WindowsInputMonitor* instance_;
     
+    // Hooks only enqueue; sounds are triggered from the dispatcher thread so the
+    // system-wide input path never waits on audio work
+    SpscQueue<InputEvent, 1024> eventQueue_;
+    HANDLE wakeEvent_ = nullptr;
+    std::thread dispatcherThread_;
+    std::atomic<bool> dispatching_{false};
+    std::atomic<size_t> maxQueueDepth_{0};
+    std::atomic<uint64_t> dispatchedEvents_{0};
+    std::atomic<uint64_t> droppedEvents_{0};
+    
     static LRESULT CALLBACK LowLevelMouseProc(int nCode, WPARAM wParam, LPARAM lParam);
     static LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam);
+    void enqueue(const InputEvent& event);
+    void dispatchLoop();
+
+public:
+    bool initialize() override;
+    void setMouseCallback(MouseCallback callback) override;
+    void setKeyboardCallback(KeyboardCallback callback) override;
+    void clearCallbacks() override;
+    void startMonitoring() override;
+    void stopMonitoring() override;
+    InputQueueStats getQueueStats() const override;
+    ~WindowsInputMonitor();
+};
+#endif
+
+#ifdef PLATFORM_LINUX
+// Reads evdev devices directly. Everything runs on one epoll loop in startMonitoring(): device
+// reads, /dev/input hot-plug through inotify, and the stop signal through an eventfd
+class LinuxInputMonitor : public InputMonitor {
+private:
+    struct Device {
+        std::string path;
+        std::array<input_event, 64> events; // One read per wakeup drains up to this many
+        size_t pendingBytes = 0; // Partial record left over from a pipe read
+    };
     
+    MouseCallback mouseCallback_;
+    KeyboardCallback keyboardCallback_;
+    std::vector<std::string> devicePaths_;
+    std::unordered_map<int, std::unique_ptr<Device>> devices_; // Keyed by file descriptor
+    int epollFd_ = -1;
+    int inotifyFd_ = -1;
+    int wakeFd_ = -1;
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> dispatchedEvents_{0};
+    
+    bool openDevice(const std::string& path, bool quiet);
+    void closeDevice(int fd);
+    void readDevice(int fd, Device& device);
+    void readHotplug();
+    void processEvent(const input_event& event);
+
 public:
+    explicit LinuxInputMonitor(std::vector<std::string> devicePaths = {});
+    ~LinuxInputMonitor();
+    
+    // Adds an already-open descriptor that yields struct input_event records. Works for evdev
+    // nodes, uinput devices and pipes replaying recorded events; the monitor takes ownership
+    bool addDevice(int fd, const std::string& name);
+    
     bool initialize() override;
     void setMouseCallback(MouseCallback callback) override;
     void setKeyboardCallback(KeyboardCallback callback) override;
-    void setUpdateCallback(UpdateCallback callback) override;
     void clearCallbacks() override;
     void startMonitoring() override;
     void stopMonitoring() override;
+    InputQueueStats getQueueStats() const override;
 };
 #endif
@@ -0,0 +1,93 @@
+#include "input_trace.h"
+#include "key_mapping.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+
+bool InputTrace::load(const std::string& filepath, std::vector<InputEvent>& events) {
+    std::ifstream file(filepath);
+    if (!file.is_open()) {
+        std::cerr << "Could not open input trace: " << filepath << std::endl;
+        return false;
+    }
+    
+    events.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') continue;
+        
+        InputEvent event;
+        if (!parseLine(line, event)) {
+            std::cerr << filepath << ":" << lineNumber << ": invalid trace event: " << line << std::endl;
+            return false;
+        }
+        events.push_back(event);
+    }
+    
+    // Stable so events recorded at the same instant keep their file order
+    std::stable_sort(events.begin(), events.end(), [](const InputEvent& a, const InputEvent& b) {
+        return a.timestampUs < b.timestampUs;
+    });
+    return true;
+}
+
+bool InputTrace::parseLine(const std::string& line, InputEvent& event) {
+    std::istringstream stream(line);
+    double timeMs = 0.0;
+    std::string device, code, action;
+    if (!(stream >> timeMs >> device >> code >> action) || timeMs < 0.0) {
+        return false;
+    }
+    
+    event.timestampUs = static_cast<uint64_t>(timeMs * 1000.0 + 0.5);
+    
+    if (device == "key") {
+        event.type = InputEvent::KEYBOARD;
+        
+        int keyCode = KeyMapping::getKeyCode(code);
+        if (keyCode < 0) {
+            char* end = nullptr;
+            long value = std::strtol(code.c_str(), &end, 0);
+            if (*end != '\0' || value < 0 || value > 0xFFFF) return false;
+            keyCode = static_cast<int>(value);
+        }
+        event.code = static_cast<uint16_t>(keyCode);
+        
+        if (action == "down") event.action = static_cast<uint8_t>(KeyEvent::DOWN);
+        else if (action == "up") event.action = static_cast<uint8_t>(KeyEvent::UP);
+        else return false;
+        return true;
+    }
+    
+    if (device == "mouse") {
+        event.type = InputEvent::MOUSE;
+        
+        if (code == "wheel") {
+            event.code = static_cast<uint16_t>(MouseButton::MIDDLE);
+            if (action == "up") event.action = static_cast<uint8_t>(MouseEvent::WHEEL_UP);
+            else if (action == "down") event.action = static_cast<uint8_t>(MouseEvent::WHEEL_DOWN);
+            else return false;
+            return true;
+        }
+        
+        if (code == "left") event.code = static_cast<uint16_t>(MouseButton::LEFT);
+        else if (code == "right") event.code = static_cast<uint16_t>(MouseButton::RIGHT);
+        else if (code == "middle") event.code = static_cast<uint16_t>(MouseButton::MIDDLE);
+        else if (code == "x1") event.code = static_cast<uint16_t>(MouseButton::X1);
+        else if (code == "x2") event.code = static_cast<uint16_t>(MouseButton::X2);
+        else return false;
+        
+        if (action == "down") event.action = static_cast<uint8_t>(MouseEvent::BUTTON_DOWN);
+        else if (action == "up") event.action = static_cast<uint8_t>(MouseEvent::BUTTON_UP);
+        else return false;
+        return true;
+    }
+    
+    return false;
+}
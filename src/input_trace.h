@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "input_monitor.h"
+
+// Recorded input for offline rendering. A trace is a text file with one event per line:
+//
+//     # time_ms  device  code    action
+//     0          key     a       down
+//     85.5       key     a       up
+//     400        mouse   left    down
+//     410        mouse   wheel   up
+//
+// Keys are given by name (see KeyMapping) or by their numeric platform key code. Mouse buttons are
+// left/right/middle/x1/x2 with down/up, and the wheel takes up/down. Blank lines and lines starting
+// with '#' are ignored. Events come back sorted by time, stamped in microseconds from the trace start.
+class InputTrace {
+public:
+    static bool load(const std::string& filepath, std::vector<InputEvent>& events);
+
+private:
+    static bool parseLine(const std::string& line, InputEvent& event);
+};
@@ -0,0 +1,93 @@
+#include "key_layout.h"
+#include "key_mapping.h"
+#include "config.h"
+#include <vector>
+
+// One key (or, with an empty name, a gap) and its width in key units
+struct LayoutKey {
+    const char* name;
+    float width;
+};
+
+typedef std::vector<LayoutKey> LayoutRow;
+
+// Full-size ANSI board, back row first: 15 units of main block, navigation cluster from 15.25 and
+// numpad from 18.5 to 22.5. Keys KeyMapping has no name for (num lock, the ISO 102nd key) are gaps
+static std::vector<LayoutRow> ansi_rows() {
+    return {
+        {{"escape", 1}, {"", 1}, {"f1", 1}, {"f2", 1}, {"f3", 1}, {"f4", 1}, {"", 0.5f},
+         {"f5", 1}, {"f6", 1}, {"f7", 1}, {"f8", 1}, {"", 0.5f},
+         {"f9", 1}, {"f10", 1}, {"f11", 1}, {"f12", 1}, {"", 0.25f},
+         {"printscreen", 1}, {"scrolllock", 1}, {"pause", 1}},
+        {{"grave", 1}, {"1", 1}, {"2", 1}, {"3", 1}, {"4", 1}, {"5", 1}, {"6", 1}, {"7", 1},
+         {"8", 1}, {"9", 1}, {"0", 1}, {"minus", 1}, {"equal", 1}, {"backspace", 2}, {"", 0.25f},
+         {"insert", 1}, {"home", 1}, {"pageup", 1}, {"", 0.25f},
+         {"", 1}, {"numpaddivide", 1}, {"numpadmultiply", 1}, {"numpadminus", 1}},
+        {{"tab", 1.5f}, {"q", 1}, {"w", 1}, {"e", 1}, {"r", 1}, {"t", 1}, {"y", 1}, {"u", 1},
+         {"i", 1}, {"o", 1}, {"p", 1}, {"leftbracket", 1}, {"rightbracket", 1}, {"backslash", 1.5f}, {"", 0.25f},
+         {"delete", 1}, {"end", 1}, {"pagedown", 1}, {"", 0.25f},
+         {"numpad7", 1}, {"numpad8", 1}, {"numpad9", 1}, {"numpadplus", 1}},
+        {{"capslock", 1.75f}, {"a", 1}, {"s", 1}, {"d", 1}, {"f", 1}, {"g", 1}, {"h", 1}, {"j", 1},
+         {"k", 1}, {"l", 1}, {"semicolon", 1}, {"apostrophe", 1}, {"enter", 2.25f}, {"", 3.5f},
+         {"numpad4", 1}, {"numpad5", 1}, {"numpad6", 1}},
+        {{"lshift", 2.25f}, {"z", 1}, {"x", 1}, {"c", 1}, {"v", 1}, {"b", 1}, {"n", 1}, {"m", 1},
+         {"comma", 1}, {"dot", 1}, {"slash", 1}, {"rshift", 2.75f}, {"", 1.25f},
+         {"up", 1}, {"", 1.25f},
+         {"numpad1", 1}, {"numpad2", 1}, {"numpad3", 1}, {"numpadenter", 1}},
+        {{"lctrl", 1.25f}, {"lwin", 1.25f}, {"lalt", 1.25f}, {"space", 6.25f},
+         {"ralt", 1.25f}, {"rwin", 1.25f}, {"menu", 1.25f}, {"rctrl", 1.25f}, {"", 0.25f},
+         {"left", 1}, {"down", 1}, {"right", 1}, {"", 0.25f},
+         {"numpad0", 2}, {"numpaddot", 1}},
+    };
+}
+
+// ISO moves backslash next to a narrower, two-row enter (placed on the home row here) and
+// shortens left shift to make room for the 102nd key
+static std::vector<LayoutRow> iso_rows() {
+    std::vector<LayoutRow> rows = ansi_rows();
+    rows[2][13] = {"", 1.5f};
+    rows[3][12] = {"backslash", 1};
+    rows[3].insert(rows[3].begin() + 13, {"enter", 1.25f});
+    rows[4][0] = {"lshift", 1.25f};
+    rows[4].insert(rows[4].begin() + 1, {"", 1});
+    return rows;
+}
+
+// The typist sits centred on the main block, which spans -0.7 to 0.7. The navigation cluster and
+// the numpad share what is left on the right
+static const float kMainBlockWidth = 15.0f;
+static const float kBoardWidth = 22.5f;
+static const float kMainBlockSpread = 0.7f;
+
+static float key_x(float centre) {
+    if (centre <= kMainBlockWidth) {
+        return (centre / kMainBlockWidth * 2.0f - 1.0f) * kMainBlockSpread;
+    }
+    return kMainBlockSpread + (centre - kMainBlockWidth) / (kBoardWidth - kMainBlockWidth) * (1.0f - kMainBlockSpread);
+}
+
+void KeyLayout::build(KeyboardLayout layout) {
+    positions_.fill(KeyPosition());
+    layout_ = layout;
+    if (layout == KeyboardLayout::NONE) return;
+    
+    std::vector<LayoutRow> rows = layout == KeyboardLayout::ISO ? iso_rows() : ansi_rows();
+    const float lastRow = static_cast<float>(rows.size() - 1);
+    for (size_t row = 0; row < rows.size(); row++) {
+        float left = 0.0f;
+        for (const LayoutKey& key : rows[row]) {
+            float centre = left + key.width * 0.5f;
+            left += key.width;
+            if (key.name[0] == '\0') continue;
+            
+            int code = KeyMapping::getKeyCode(key.name);
+            // Windows reports both enter keys as VK_RETURN; the main one is placed first and kept
+            if (!KeyStateTable::contains(code) || positions_[code].known) continue;
+            
+            KeyPosition& position = positions_[code];
+            position.x = key_x(centre);
+            position.depth = (lastRow - static_cast<float>(row)) / lastRow;
+            position.known = true;
+        }
+    }
+}
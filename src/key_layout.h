@@ -0,0 +1,30 @@
+#pragma once
+#include <array>
+#include "key_state.h"
+
+enum class KeyboardLayout;
+
+// Where a key sits on a full-size keyboard, numpad included
+struct KeyPosition {
+    float x = 0.0f;     // -0.7 to 0.7 across the main block, up to 1 at the right edge of the numpad
+    float depth = 0.0f; // 0 for the space bar row, 1 for the function key row
+    bool known = false;
+};
+
+// Key positions indexed by key code. Built from a physical layout description and KeyMapping's
+// key names whenever the layout setting changes, so a keystroke costs one array lookup
+class KeyLayout {
+public:
+    void build(KeyboardLayout layout);
+    KeyboardLayout layout() const { return layout_; }
+    
+    // Codes outside the layout come back with known = false
+    const KeyPosition& position(int keyCode) const {
+        static const KeyPosition unknown;
+        return KeyStateTable::contains(keyCode) ? positions_[keyCode] : unknown;
+    }
+
+private:
+    std::array<KeyPosition, kKeyCodeCount> positions_{};
+    KeyboardLayout layout_{};
+};
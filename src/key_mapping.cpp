@@ -1,10 +1,23 @@
 #include "key_mapping.h"
+#include "key_state.h"
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
 
 #ifdef PLATFORM_WINDOWS
 #include <windows.h>
+#endif
+
+namespace {
 
-const std::unordered_map<std::string, int> KeyMapping::keyNameToCode_ = {
+struct KeyName {
+    std::string_view name; // Lowercase
+    int code;
+};
+
+#ifdef PLATFORM_WINDOWS
+constexpr KeyName kKeyNames[] = {
     // Letters
     {"a", 0x41}, {"b", 0x42}, {"c", 0x43}, {"d", 0x44}, {"e", 0x45},
     {"f", 0x46}, {"g", 0x47}, {"h", 0x48}, {"i", 0x49}, {"j", 0x4A},
@@ -52,7 +65,7 @@ const std::unordered_map<std::string, int> KeyMapping::keyNameToCode_ = {
 
 #else
 // Linux key codes (using Linux input event codes)
-const std::unordered_map<std::string, int> KeyMapping::keyNameToCode_ = {
+constexpr KeyName kKeyNames[] = {
     // Letters (KEY_A = 30, KEY_B = 48, etc.)
     {"a", 30}, {"b", 48}, {"c", 46}, {"d", 32}, {"e", 18},
     {"f", 33}, {"g", 34}, {"h", 35}, {"i", 23}, {"j", 36},
@@ -99,23 +112,146 @@ const std::unordered_map<std::string, int> KeyMapping::keyNameToCode_ = {
 };
 #endif
 
-const std::unordered_map<int, std::string> KeyMapping::keyCodeToName_ = []() {
-    std::unordered_map<int, std::string> reverse;
-    for (const auto& pair : keyNameToCode_) {
-        reverse[pair.second] = pair.first;
+constexpr size_t kKeyNameCount = sizeof(kKeyNames) / sizeof(kKeyNames[0]);
+
+// Name lookups go through a two-level perfect hash built by the compiler (hash and displace): the
+// first hash picks a bucket, and each bucket stores the seed of a second hash that sends all of its
+// names to distinct slots. A lookup is one pass over the name, two table reads and one comparison
+constexpr size_t kNameBuckets = 64;
+constexpr size_t kNameSlots = 256;
+static_assert(kKeyNameCount < 255, "Key name slots hold the name index in a byte");
+
+constexpr char fold_case(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// FNV-1a over the lowercased name, so lookups don't need a lowercased copy
+constexpr uint32_t name_hash(std::string_view name) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(fold_case(c));
+        hash *= 16777619u;
     }
-    return reverse;
-}();
+    return hash;
+}
+
+// Bucket (seed 0) and slot positions from the name hash, so each lookup walks the name only once
+constexpr uint32_t mix_hash(uint32_t hash, uint32_t seed) {
+    hash ^= seed * 0x9E3779B9u;
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    hash ^= hash >> 12;
+    return hash;
+}
+
+constexpr size_t name_bucket(uint32_t hash) {
+    return mix_hash(hash, 0) % kNameBuckets;
+}
+
+constexpr bool same_name(std::string_view keyName, std::string_view lowercaseName) {
+    if (keyName.size() != lowercaseName.size()) return false;
+    for (size_t i = 0; i < keyName.size(); i++) {
+        if (fold_case(keyName[i]) != lowercaseName[i]) return false;
+    }
+    return true;
+}
+
+struct KeyNameTable {
+    std::array<uint16_t, kNameBuckets> seeds{};
+    std::array<uint8_t, kNameSlots> slots{}; // Index into kKeyNames plus one, 0 = empty
+    bool complete = false; // Every name got a slot
+};
 
-int KeyMapping::getKeyCode(const std::string& keyName) {
-    std::string lowerKey = keyName;
-    std::transform(lowerKey.begin(), lowerKey.end(), lowerKey.begin(), ::tolower);
+// Every constant evaluation has to stay within the compilers' step limits (MSVC's default is 100k),
+// so each name is hashed in an evaluation of its own and the seed search below only works on those
+// hashes, one bucket's names at a time
+template <size_t Index>
+constexpr uint32_t kKeyNameHash = name_hash(kKeyNames[Index].name);
+
+template <size_t... Indices>
+constexpr std::array<uint32_t, kKeyNameCount> key_name_hashes(std::index_sequence<Indices...>) {
+    return {kKeyNameHash<Indices>...};
+}
+
+constexpr std::array<uint32_t, kKeyNameCount> kKeyNameHashes = key_name_hashes(std::make_index_sequence<kKeyNameCount>());
+
+constexpr KeyNameTable build_key_name_table() {
+    KeyNameTable table;
+    
+    // Names sorted by bucket: bucket b holds members[bucketStart[b]] up to members[bucketStart[b + 1]]
+    size_t bucketStart[kNameBuckets + 1] = {};
+    uint32_t bucketOf[kKeyNameCount] = {};
+    for (size_t i = 0; i < kKeyNameCount; i++) {
+        bucketOf[i] = static_cast<uint32_t>(name_bucket(kKeyNameHashes[i]));
+        bucketStart[bucketOf[i] + 1]++;
+    }
     
-    auto it = keyNameToCode_.find(lowerKey);
-    return (it != keyNameToCode_.end()) ? it->second : -1;
+    size_t largestBucket = 0;
+    for (size_t bucket = 0; bucket < kNameBuckets; bucket++) {
+        largestBucket = std::max(largestBucket, bucketStart[bucket + 1]);
+        bucketStart[bucket + 1] += bucketStart[bucket];
+    }
+    uint32_t members[kKeyNameCount] = {};
+    size_t filled[kNameBuckets] = {};
+    for (size_t i = 0; i < kKeyNameCount; i++) {
+        members[bucketStart[bucketOf[i]] + filled[bucketOf[i]]++] = static_cast<uint32_t>(i);
+    }
+    
+    // Biggest buckets first, while most slots are still free
+    for (size_t size = largestBucket; size > 0; size--) {
+        for (size_t bucket = 0; bucket < kNameBuckets; bucket++) {
+            size_t first = bucketStart[bucket], last = bucketStart[bucket + 1];
+            if (last - first != size) continue;
+            
+            bool placed = false;
+            for (uint32_t seed = 1; seed <= 0xFFFF && !placed; seed++) {
+                size_t taken = first; // members[first] up to members[taken] hold a slot under this seed
+                for (; taken < last; taken++) {
+                    uint8_t& slot = table.slots[mix_hash(kKeyNameHashes[members[taken]], seed) % kNameSlots];
+                    if (slot != 0) break;
+                    slot = static_cast<uint8_t>(members[taken] + 1);
+                }
+                placed = taken == last;
+                if (placed) {
+                    table.seeds[bucket] = static_cast<uint16_t>(seed);
+                } else {
+                    // Take back this seed's names before trying the next one
+                    for (size_t m = first; m < taken; m++) {
+                        table.slots[mix_hash(kKeyNameHashes[members[m]], seed) % kNameSlots] = 0;
+                    }
+                }
+            }
+            if (!placed) return table;
+        }
+    }
+    table.complete = true;
+    return table;
 }
 
-std::string KeyMapping::getKeyName(int keyCode) {
-    auto it = keyCodeToName_.find(keyCode);
-    return (it != keyCodeToName_.end()) ? it->second : std::to_string(keyCode);
-}
\ No newline at end of file
+// Names sharing a code (shift and lshift, enter and numpadenter on Windows): the first one listed wins
+constexpr std::array<std::string_view, kKeyCodeCount> build_key_code_names() {
+    std::array<std::string_view, kKeyCodeCount> names{};
+    for (const KeyName& key : kKeyNames) {
+        if (names[key.code].empty()) names[key.code] = key.name;
+    }
+    return names;
+}
+
+constexpr KeyNameTable kKeyNameTable = build_key_name_table();
+// Also fails on a name listed twice, or two names with the same 32-bit hash, since those always share a slot
+static_assert(kKeyNameTable.complete, "No perfect hash found for the key names, raise kNameSlots");
+
+constexpr std::array<std::string_view, kKeyCodeCount> kKeyCodeNames = build_key_code_names();
+
+} // namespace
+
+int KeyMapping::getKeyCode(std::string_view keyName) {
+    uint32_t hash = name_hash(keyName);
+    int index = kKeyNameTable.slots[mix_hash(hash, kKeyNameTable.seeds[name_bucket(hash)]) % kNameSlots] - 1;
+    if (index < 0 || !same_name(keyName, kKeyNames[index].name)) return -1;
+    return kKeyNames[index].code;
+}
+
+std::string_view KeyMapping::getKeyName(int keyCode) {
+    return KeyStateTable::contains(keyCode) ? kKeyCodeNames[keyCode] : std::string_view();
+}
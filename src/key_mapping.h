@@ -1,13 +1,12 @@
 #pragma once
-#include <string>
-#include <unordered_map>
+#include <string_view>
 
+// Key names used in the config and in input traces. Both directions are tables built at compile
+// time, so lookups don't allocate and there is nothing to initialize at startup
 class KeyMapping {
 public:
-    static int getKeyCode(const std::string& keyName);
-    static std::string getKeyName(int keyCode);
-    
-private:
-    static const std::unordered_map<std::string, int> keyNameToCode_;
-    static const std::unordered_map<int, std::string> keyCodeToName_;
-};
\ No newline at end of file
+    // Case-insensitive, -1 for unknown names
+    static int getKeyCode(std::string_view keyName);
+    // Empty for codes without a name
+    static std::string_view getKeyName(int keyCode);
+};
@@ -0,0 +1,82 @@
+#include "key_sounds.h"
+#include "config.h"
+#include "audio_player.h"
+#include <algorithm>
+
+// A pause counts as this long, so one slow key doesn't drag the speed down for the next burst
+constexpr int kMaxPressIntervalMs = 1000;
+// How far each press moves the smoothed interval towards the latest one
+constexpr float kPressIntervalSmoothing = 0.3f;
+
+void KeySoundTable::build(const KeyboardConfig& keyboard, AudioPlayer& player) {
+    defaultSamples_.clear();
+    for (const std::string& path : keyboard.sounds) {
+        defaultSamples_.push_back({path, player.getSample(path)});
+    }
+    
+    sets_.clear();
+    setForKey_.fill(-1);
+    for (const KeySoundSet& config : keyboard.keySounds) {
+        Set set;
+        set.order = config.order;
+        for (const KeySoundLayer& layerConfig : config.layers) {
+            Layer layer;
+            layer.minKeysPerSecond = layerConfig.minKeysPerSecond;
+            for (const std::string& path : layerConfig.sounds) {
+                layer.samples.push_back({path, player.getSample(path)});
+            }
+            if (layer.samples.empty()) continue;
+            layer.last = layer.samples.size() - 1; // Round robin starts with the first sample
+            set.layers.push_back(layer);
+        }
+        if (set.layers.empty()) continue;
+        
+        // Later sets take over the keys they share with earlier ones
+        int16_t index = static_cast<int16_t>(sets_.size());
+        sets_.push_back(set);
+        for (int keyCode = 0; keyCode < kKeyCodeCount; keyCode++) {
+            if (config.keys[keyCode]) setForKey_[keyCode] = index;
+        }
+    }
+}
+
+void KeySoundTable::adoptSamples(KeySoundTable&& built) {
+    defaultSamples_ = std::move(built.defaultSamples_);
+    sets_ = std::move(built.sets_);
+    setForKey_ = built.setForKey_;
+    built.defaultSamples_.clear();
+    built.sets_.clear();
+    built.setForKey_.fill(-1);
+}
+
+void KeySoundTable::notePress(int timeMs) {
+    int intervalMs = pressed_ ? std::min(timeMs - lastPressMs_, kMaxPressIntervalMs) : kMaxPressIntervalMs;
+    pressIntervalMs_ += kPressIntervalSmoothing * (std::max(intervalMs, 1) - pressIntervalMs_);
+    lastPressMs_ = timeMs;
+    pressed_ = true;
+}
+
+KeySample& KeySoundTable::pick(int keyCode, std::mt19937& rng) {
+    Set& set = sets_[setForKey_[keyCode]];
+    
+    // Fastest layer the typing has reached, the first one below all of them
+    float speed = keysPerSecond();
+    size_t layerIndex = 0;
+    while (layerIndex + 1 < set.layers.size() && set.layers[layerIndex + 1].minKeysPerSecond <= speed) {
+        layerIndex++;
+    }
+    Layer& layer = set.layers[layerIndex];
+    
+    size_t count = layer.samples.size();
+    if (count > 1) {
+        if (set.order == KeySoundOrder::ROUND_ROBIN) {
+            layer.last = (layer.last + 1) % count;
+        } else {
+            // Any sample but the last one, so the set never plays the same sample twice in a row
+            std::uniform_int_distribution<size_t> dist(0, count - 2);
+            size_t next = dist(rng);
+            layer.last = next >= layer.last ? next + 1 : next;
+        }
+    }
+    return layer.samples[layer.last];
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "key_state.h"
+#include "sample_cache.h"
+
+struct KeyboardConfig;
+enum class KeySoundOrder;
+class AudioPlayer;
+
+// A configured sound file and its sample handle. The handle is null until the sample cache has the
+// file; callers fill it in with AudioPlayer::getSample() the first time it's played after that
+struct KeySample {
+    std::string filepath;
+    SampleHandle sample;
+};
+
+// keyboard.sounds and keyboard.key_sounds resolved when the config is applied, so a keystroke picks
+// its sample with a few array lookups and only touches a path until the sample is cached
+class KeySoundTable {
+public:
+    // Handles are taken from whatever the player has cached so far; the rest are resolved on play
+    void build(const KeyboardConfig& keyboard, AudioPlayer& player);
+    
+    // Takes over the samples of a table built off to the side, keeping the typing speed. The
+    // other table is left empty
+    void adoptSamples(KeySoundTable&& built);
+    
+    // keyboard.sounds in config order
+    std::vector<KeySample>& defaultSamples() { return defaultSamples_; }
+    
+    // keyCode must pass KeyStateTable::contains()
+    bool hasSet(int keyCode) const { return setForKey_[keyCode] >= 0; }
+    
+    // Counts an accepted press (not an auto-repeat) towards the typing speed that picks layers
+    void notePress(int timeMs);
+    float keysPerSecond() const { return 1000.0f / pressIntervalMs_; }
+    
+    // Next sample from the key's set for the current typing speed. The key must have a set
+    KeySample& pick(int keyCode, std::mt19937& rng);
+
+private:
+    struct Layer {
+        float minKeysPerSecond = 0.0f;
+        std::vector<KeySample> samples; // Never empty
+        size_t last = 0; // Round-robin position, or the random pick to avoid next time
+    };
+    
+    struct Set {
+        KeySoundOrder order;
+        std::vector<Layer> layers; // Ascending minKeysPerSecond, never empty
+    };
+    
+    std::vector<KeySample> defaultSamples_;
+    std::vector<Set> sets_;
+    std::array<int16_t, kKeyCodeCount> setForKey_{}; // Index into sets_, -1 = play from defaultSamples_
+    int lastPressMs_ = 0;
+    bool pressed_ = false; // Whether lastPressMs_ is set
+    float pressIntervalMs_ = 1000.0f; // Smoothed time between presses
+};
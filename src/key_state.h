@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <bitset>
+
+// Exclusive bound on key codes: Windows virtual keys stay below 256, evdev key codes below KEY_CNT (0x300)
+constexpr int kKeyCodeCount = 0x300;
+
+// One bit per key code
+typedef std::bitset<kKeyCodeCount> KeySet;
+
+// What the keyboard handler remembers about one key
+struct KeyState {
+    int lastPressMs = 0;  // Last accepted press, only meaningful while the key is held
+    int soundId = 0;      // Sound to fade out when the key is released, 0 = none
+    int soundIndex = -1;  // Sound from keyboard.sounds assigned to the key, -1 = not picked yet
+};
+
+// Per-key state in a flat array indexed by key code, with the held keys in a bitset. Handling a
+// keystroke is a couple of indexed loads and stores, with no hashing and no allocation
+class KeyStateTable {
+public:
+    static bool contains(int keyCode) { return keyCode >= 0 && keyCode < kKeyCodeCount; }
+    
+    // keyCode must pass contains()
+    KeyState& operator[](int keyCode) { return states_[keyCode]; }
+    bool isPressed(int keyCode) const { return pressed_[keyCode]; }
+    void setPressed(int keyCode, bool pressed) { pressed_[keyCode] = pressed; }
+    
+    // Every key picks a new sound on its next press
+    void clearSoundAssignments() {
+        for (KeyState& state : states_) {
+            state.soundIndex = -1;
+        }
+    }
+
+private:
+    std::array<KeyState, kKeyCodeCount> states_{};
+    KeySet pressed_;
+};
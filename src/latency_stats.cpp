@@ -0,0 +1,110 @@
+#include "latency_stats.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+int LatencyHistogram::bucketFor(uint64_t us) {
+    if (us < kLinearBuckets) return static_cast<int>(us);
+    
+    int octave = 63;
+    while (!(us >> octave)) octave--;
+    int step = static_cast<int>((us >> (octave - 3)) & (kStepsPerOctave - 1));
+    return kLinearBuckets + (octave - 4) * kStepsPerOctave + step;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int bucket) {
+    if (bucket < kLinearBuckets) return static_cast<uint64_t>(bucket);
+    
+    int octave = (bucket - kLinearBuckets) / kStepsPerOctave + 4;
+    uint64_t step = static_cast<uint64_t>((bucket - kLinearBuckets) % kStepsPerOctave);
+    uint64_t width = 1ull << (octave - 3);
+    return (1ull << octave) + (step + 1) * width - 1;
+}
+
+void LatencyHistogram::record(uint64_t us) {
+    buckets_[bucketFor(us)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(us, std::memory_order_relaxed);
+    
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (us > max && !max_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Summary LatencyHistogram::summarize() const {
+    // Copy first so the percentiles are computed from one consistent set of counts
+    std::array<uint64_t, kBucketCount> counts;
+    uint64_t total = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    
+    Summary summary;
+    summary.count = total;
+    summary.max = max_.load(std::memory_order_relaxed);
+    if (total == 0) return summary;
+    summary.mean = static_cast<double>(sum_.load(std::memory_order_relaxed)) / count_.load(std::memory_order_relaxed);
+    
+    auto percentile = [&](double fraction) {
+        uint64_t rank = static_cast<uint64_t>(fraction * total + 0.5);
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < kBucketCount; i++) {
+            seen += counts[i];
+            if (seen >= rank) return std::min(bucketUpperBound(i), summary.max);
+        }
+        return summary.max;
+    };
+    summary.p50 = percentile(0.50);
+    summary.p95 = percentile(0.95);
+    summary.p99 = percentile(0.99);
+    return summary;
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyStats::nowUs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+const char* LatencyStats::stageName(Stage stage) {
+    switch (stage) {
+        case INPUT_TO_PLAY: return "input -> play";
+        case PLAY_TO_START: return "play -> start";
+        case START_TO_RENDER: return "start -> render";
+        case INPUT_TO_RENDER: return "input -> render";
+        default: return "?";
+    }
+}
+
+void LatencyStats::reset() {
+    for (auto& stage : stages_) {
+        stage.reset();
+    }
+}
+
+std::string LatencyStats::report() const {
+    std::ostringstream out;
+    out << "Latency (us)        count      p50      p95      p99      max\n";
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        Stage stage = static_cast<Stage>(i);
+        LatencyHistogram::Summary summary = summarize(stage);
+        out << std::left << std::setw(16) << stageName(stage) << std::right
+            << std::setw(9) << summary.count
+            << std::setw(9) << summary.p50
+            << std::setw(9) << summary.p95
+            << std::setw(9) << summary.p99
+            << std::setw(9) << summary.max << "\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Lock-free histogram of durations in microseconds. record() is a couple of relaxed atomic adds,
+// so it can be called from hooks and the audio callback. Buckets are exact below 16us and then
+// split every power of two into 8 steps, which keeps percentiles within about 12%.
+class LatencyHistogram {
+public:
+    struct Summary {
+        uint64_t count = 0;
+        uint64_t p50 = 0;
+        uint64_t p95 = 0;
+        uint64_t p99 = 0;
+        uint64_t max = 0;
+        double mean = 0.0;
+    };
+    
+    void record(uint64_t us);
+    Summary summarize() const;
+    void reset();
+
+private:
+    static constexpr int kLinearBuckets = 16;
+    static constexpr int kStepsPerOctave = 8;
+    static constexpr int kBucketCount = kLinearBuckets + (64 - 4) * kStepsPerOctave;
+    
+    static int bucketFor(uint64_t us);
+    static uint64_t bucketUpperBound(int bucket);
+    
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// Where the time between a physical click and its first rendered frame goes. Each stage is
+// measured between two timestamps on the same steady clock as InputMonitor::nowUs():
+//   input -> play    hook receipt until the player is asked to play (queueing, dispatch, handler)
+//   play -> start    inside the player: locking, voice reclaim, cache lookup or decode, routing
+//   start -> render  until the audio callback first reads the voice (device buffering)
+//   input -> render  the whole path
+class LatencyStats {
+public:
+    enum Stage { INPUT_TO_PLAY, PLAY_TO_START, START_TO_RENDER, INPUT_TO_RENDER, STAGE_COUNT };
+    
+    static uint64_t nowUs();
+    static const char* stageName(Stage stage);
+    
+    void record(Stage stage, uint64_t us) { stages_[stage].record(us); }
+    LatencyHistogram::Summary summarize(Stage stage) const { return stages_[stage].summarize(); }
+    void reset();
+    
+    // Multi-line table with one row per stage
+    std::string report() const;
+
+private:
+    std::array<LatencyHistogram, STAGE_COUNT> stages_;
+};
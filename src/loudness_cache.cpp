@@ -0,0 +1,113 @@
+#include "loudness_cache.h"
+#include "nlohmann/json.hpp"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// Bumped when the way loudness is measured changes, which invalidates every cached value
+static const int kLoudnessCacheVersion = 1;
+
+// JSON has no infinity; silent files are stored with this level instead
+static const float kSilenceDb = -200.0f;
+
+static float from_json_db(float db) {
+    return db <= kSilenceDb ? -INFINITY : db;
+}
+
+static float to_json_db(float db) {
+    return std::isfinite(db) ? db : kSilenceDb;
+}
+
+LoudnessCache::LoudnessCache(const std::string& directory, uint32_t channels, uint32_t sampleRate)
+    : path_((fs::path(directory) / kFileName).string()), channels_(channels), sampleRate_(sampleRate) {
+    std::ifstream file(path_);
+    if (!file.is_open()) return;
+    
+    try {
+        json j;
+        file >> j;
+        if (j.value("version", 0) != kLoudnessCacheVersion) return;
+        if (j.value("channels", 0u) != channels_ || j.value("sample_rate", 0u) != sampleRate_) return;
+        
+        for (const auto& item : j.at("files").items()) {
+            Entry entry;
+            entry.size = item.value().at("size").get<uint64_t>();
+            entry.modified = item.value().at("modified").get<int64_t>();
+            entry.level.loudnessDb = from_json_db(item.value().at("loudness_db").get<float>());
+            entry.level.peakDb = from_json_db(item.value().at("peak_db").get<float>());
+            entries_[item.key()] = entry;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Ignoring loudness cache " << path_ << ": " << e.what() << std::endl;
+        entries_.clear();
+    }
+}
+
+bool LoudnessCache::stamp(const std::string& filepath, Entry& entry) {
+    std::error_code error;
+    entry.size = fs::file_size(filepath, error);
+    if (error) return false;
+    entry.modified = fs::last_write_time(filepath, error).time_since_epoch().count();
+    return !error;
+}
+
+bool LoudnessCache::find(const std::string& filepath, Level& level) const {
+    auto it = entries_.find(fs::path(filepath).filename().string());
+    if (it == entries_.end()) return false;
+    
+    Entry current;
+    if (!stamp(filepath, current) || current.size != it->second.size || current.modified != it->second.modified) {
+        return false;
+    }
+    level = it->second.level;
+    return true;
+}
+
+void LoudnessCache::store(const std::string& filepath, const Level& level) {
+    Entry entry;
+    if (!stamp(filepath, entry)) return;
+    entry.level = level;
+    
+    Entry& cached = entries_[fs::path(filepath).filename().string()];
+    if (cached.size == entry.size && cached.modified == entry.modified) return; // Already up to date
+    cached = entry;
+    changed_ = true;
+}
+
+bool LoudnessCache::save() {
+    if (!changed_) return true;
+    
+    json files = json::object();
+    for (const auto& pair : entries_) {
+        files[pair.first] = {
+            {"size", pair.second.size},
+            {"modified", pair.second.modified},
+            {"loudness_db", to_json_db(pair.second.level.loudnessDb)},
+            {"peak_db", to_json_db(pair.second.level.peakDb)},
+        };
+    }
+    json j = {{"version", kLoudnessCacheVersion}, {"channels", channels_}, {"sample_rate", sampleRate_}, {"files", files}};
+    
+    // Written beside the real file and renamed over it, so a reader never sees half of it
+    std::string tempPath = path_ + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::trunc);
+        if (!file.is_open() || !(file << j.dump(2) << std::endl)) {
+            std::cerr << "Could not write loudness cache " << path_ << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    fs::rename(tempPath, path_, error);
+    if (error) {
+        std::cerr << "Could not write loudness cache " << path_ << ": " << error.message() << std::endl;
+        fs::remove(tempPath, error);
+        return false;
+    }
+    changed_ = false;
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// Loudness of the sound files in one directory, kept in a file in that directory so a restart only
+// measures files that are new or changed. Entries are keyed by file name and only trusted while the
+// file's size and write time still match. Files are measured as decoded for the output, so the cache
+// also records the channel count and sample rate and is dropped when those change
+class LoudnessCache {
+public:
+    static constexpr const char* kFileName = ".clicksounds-loudness.json";
+    
+    struct Level {
+        float loudnessDb = 0.0f; // As SoundPack::measureLevel() reports them
+        float peakDb = 0.0f;
+    };
+    
+    // Reads the directory's cache file; a missing or unreadable one, or one measured at another
+    // output format, just starts out empty
+    LoudnessCache(const std::string& directory, uint32_t channels, uint32_t sampleRate);
+    
+    // filepath is a file in this directory. False if it isn't cached or has changed since
+    bool find(const std::string& filepath, Level& level) const;
+    void store(const std::string& filepath, const Level& level);
+    
+    // Writes the cache file back if anything was stored since it was read
+    bool save();
+
+private:
+    struct Entry {
+        uint64_t size = 0;
+        int64_t modified = 0;
+        Level level;
+    };
+    
+    // Current size and write time of a file, false if it can't be read
+    static bool stamp(const std::string& filepath, Entry& entry);
+    
+    std::string path_;
+    uint32_t channels_;
+    uint32_t sampleRate_;
+    std::unordered_map<std::string, Entry> entries_; // By file name
+    bool changed_ = false;
+};
@@ -2,6 +2,10 @@
 #include "audio_player.h"
 #include "input_monitor.h"
 #include "file_watcher.h"
+#include "input_trace.h"
+#include "benchmarks.h"
+#include "key_sounds.h"
+#include "miniaudio/miniaudio.h"
 #include <iostream>
 #include <random>
 #include <unordered_map>
@@ -9,78 +13,162 @@
 #include <cstring>
 #include <string>
 #include <chrono>
+#include <ctime>
+#include <algorithm>
+#include <mutex>
 
 #ifdef PLATFORM_WINDOWS
 #include <windows.h>
 #endif
 
+// Mouse buttons share the voice key space with key codes for same-key voice stealing
+constexpr int kMouseVoiceKeyBase = 0x10000;
+
 class ClickSoundsApp {
 private:
     Config config_;
     std::unique_ptr<AudioPlayer> audioPlayer_;
     std::unique_ptr<InputMonitor> inputMonitor_;
     std::unique_ptr<FileWatcher> fileWatcher_;
-    std::unordered_map<int, int> keySoundMap_;
-    std::unordered_set<int> pressedKeys_;
+    KeyStateTable keys_; // Assigned sound, held flag, debounce time and fading sound per key code
+    KeySoundTable keySounds_; // Keyboard samples resolved from the config
+    // Held by the input handlers while they run, and by the config watcher while it swaps in what a
+    // reload built, so a handler never sees the key sound table half rebuilt
+    std::mutex inputMutex_;
     std::unordered_map<MouseButton, int> activeMouseSounds_; // Track active mouse sounds for fade-out
-    std::unordered_map<int, int> activeKeySounds_; // Track active keyboard sounds for fade-out (vkCode -> soundId)
     int lastKeyPressed_ = -1; // Track the last key pressed for true randomization
     int lastScrollTime_ = 0; // Track last scroll event time for debouncing
-    std::unordered_map<int, int> lastKeyPressTime_; // Track last press time for each key for debouncing
     std::mt19937 rng_;
     bool running_ = true;
+    bool liveInput_ = true; // False for --render, where event timestamps are on a virtual clock
+    bool printLatencyStats_ = false;
     
 public:
     ClickSoundsApp() : rng_(std::random_device{}()) {}
     
 private:
-    int getCurrentTimeMs() {
-#ifdef PLATFORM_WINDOWS
-        return GetTickCount();
-#else
-        auto now = std::chrono::steady_clock::now();
-        auto duration = now.time_since_epoch();
-        return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
-#endif
+    // Trace timestamps aren't wall-clock time, so only live input feeds the input latency stages
+    uint64_t latencyTimestamp(uint64_t timestampUs) const {
+        return liveInput_ ? timestampUs : 0;
+    }
+    
+    static long long elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
     }
     
     void onConfigChanged(const std::string& filepath) {
         std::cout << "Config file changed, reloading..." << std::endl;
         
-        if (config_.reload()) {
-            // Apply new config to audio player
-            audioPlayer_->setMaxConcurrentSounds(config_.audio.maxConcurrentSounds);
-            audioPlayer_->setMasterVolume(config_.audio.masterVolume);
-            audioPlayer_->setAudioEffects(config_.audio.effects);
-            
-            // Clear existing key sound mappings to force remapping with new sounds
-            keySoundMap_.clear();
-            
-            // Re-setup callbacks in case mouse/keyboard enabled states changed
-            setupCallbacks();
-            
-            std::cout << "Config hot reload completed successfully!" << std::endl;
-        } else {
+        ConfigDiff diff;
+        if (!reloadConfig(diff)) return;
+        if (!diff.any()) {
+            std::cout << "Config unchanged, nothing to apply" << std::endl;
+            return;
+        }
+        applyConfigDiff(diff, false);
+        std::cout << "Config hot reload applied: " << diff.describe() << std::endl;
+    }
+    
+    // Sound files were added to, removed from or rewritten in a watched directory
+    void onSoundFilesChanged(const std::vector<std::string>& filepaths) {
+        std::cout << filepaths.size() << " sound file(s) changed, updating the sample cache..." << std::endl;
+        
+        // Only the changed files are decoded again; a reload picks up files a sounds_dir gained or lost
+        audioPlayer_->forgetSounds(filepaths);
+        ConfigDiff diff;
+        if (!reloadConfig(diff)) return;
+        applyConfigDiff(diff, true);
+    }
+    
+    // Reloads into a copy and swaps it in under inputMutex_, so the handlers never read a config
+    // that's being written. The whole file is parsed before anything is swapped, so a half-written
+    // save changes nothing and the write that completes it triggers another reload. Only the config
+    // watcher thread writes config_, so it can read it without the lock
+    bool reloadConfig(ConfigDiff& diff) {
+        Config next = config_;
+        if (!next.reload(diff)) {
             std::cerr << "Failed to reload config file" << std::endl;
+            return false;
+        }
+        if (!diff.any()) return true;
+        
+        std::lock_guard<std::mutex> lock(inputMutex_);
+        config_ = std::move(next);
+        return true;
+    }
+    
+    // soundsChanged: sound files changed on disk, so their samples have to be loaded again even if
+    // the config still lists the same files
+    void applyConfigDiff(const ConfigDiff& diff, bool soundsChanged) {
+        // Keyboard and mouse volumes are read on every event, so the new value is all they need
+        if (diff.maxConcurrentSounds) audioPlayer_->setMaxConcurrentSounds(config_.audio.maxConcurrentSounds);
+        if (diff.voiceStealing) audioPlayer_->setVoiceStealPolicy(config_.audio.voiceStealing);
+        if (diff.masterVolume) audioPlayer_->setMasterVolume(config_.audio.masterVolume);
+        if (diff.effects) audioPlayer_->setAudioEffects(config_.audio.effects);
+        if (diff.latency) std::cout << "audio.latency changes take effect after a restart" << std::endl;
+        
+        // Both only drop the cached samples when they actually change. Sounds kept from the old config
+        // stay cached; new ones stream until their decode lands
+        bool samplesDropped = audioPlayer_->setSoundPack(config_.audio.soundPack);
+        samplesDropped |= audioPlayer_->setSampleLoading(config_.audio.samples);
+        if (samplesDropped || soundsChanged || diff.soundFiles) {
+            audioPlayer_->preloadSoundsAsync(config_.getSoundFiles());
         }
+        if (samplesDropped || soundsChanged || diff.soundFiles || diff.keyboardSounds || diff.keySounds) {
+            // Built off to the side; the handlers only wait for the swap
+            KeySoundTable table;
+            table.build(config_.keyboard, *audioPlayer_);
+            std::lock_guard<std::mutex> lock(inputMutex_);
+            keySounds_.adoptSamples(std::move(table));
+            
+            // Per-key picks index keyboard.sounds, so they only go stale when that list changes
+            if (diff.keyboardSounds) {
+                keys_.clearSoundAssignments();
+            }
+        }
+        
+        // Directories that stay watched keep their state, so this is cheap when nothing moved
+        watchSoundDirectories();
+    }
+    
+    void watchSoundDirectories() {
+        fileWatcher_->setDebounceMs(config_.hotReload.debounceMs);
+        std::vector<std::string> directories;
+        if (config_.hotReload.watchSounds) {
+            directories = config_.getSoundDirectories();
+        }
+        fileWatcher_->watchDirectories(directories, [this](const std::vector<std::string>& filepaths) {
+            onSoundFilesChanged(filepaths);
+        });
     }
     
 public:
     
-    bool initialize() {
+    bool initialize(const std::vector<std::string>& devicePaths = {}) {
+        auto startTime = std::chrono::steady_clock::now();
         config_ = Config::loadFromFile("config.json");
         
         audioPlayer_ = AudioPlayer::create();
-        if (!audioPlayer_->initialize()) {
+        if (!audioPlayer_->initialize(config_.audio.latency)) {
             std::cerr << "Failed to initialize audio player\n";
             return false;
         }
         
         audioPlayer_->setMaxConcurrentSounds(config_.audio.maxConcurrentSounds);
+        audioPlayer_->setVoiceStealPolicy(config_.audio.voiceStealing);
         audioPlayer_->setMasterVolume(config_.audio.masterVolume);
         audioPlayer_->setAudioEffects(config_.audio.effects);
         
-        inputMonitor_ = InputMonitor::create();
+        // Map the sound pack and decode everything it lacks in the background. Input starts right away;
+        // keys pressed before a sound is decoded stream it from disk instead of waiting
+        audioPlayer_->setSoundPack(config_.audio.soundPack);
+        audioPlayer_->setSampleLoading(config_.audio.samples);
+        audioPlayer_->preloadSoundsAsync(config_.getSoundFiles(), [startTime]() {
+            std::cout << "Sample cache ready after " << elapsedMs(startTime) << " ms" << std::endl;
+        });
+        keySounds_.build(config_.keyboard, *audioPlayer_);
+        
+        inputMonitor_ = InputMonitor::create(devicePaths);
         if (!inputMonitor_->initialize()) {
             std::cerr << "Failed to initialize input monitor\n";
             return false;
@@ -93,33 +181,126 @@ public:
         })) {
             std::cerr << "Warning: Failed to start config file watcher. Hot reloading disabled.\n";
         }
+        watchSoundDirectories();
         
         setupCallbacks();
+        std::cout << "Ready to play after " << elapsedMs(startTime) << " ms" << std::endl;
         return true;
     }
     
-    void setupCallbacks() {
-        inputMonitor_->clearCallbacks();
-
-        if (config_.mouse.enabled) {
-            inputMonitor_->setMouseCallback([this](MouseButton button, MouseEvent event) {
-                handleMouseEvent(button, event);
-            });
+    // Headless setup for --render: no audio device, no input hooks and no config watcher.
+    // Both random generators get a fixed seed so the same trace always renders the same output
+    bool initializeOffline(uint32_t channels, uint32_t sampleRate, uint32_t seed) {
+        config_ = Config::loadFromFile("config.json");
+        
+        // Synchronous playback waits for the device to drain the sound, which never happens offline
+        config_.audio.asyncPlayback = true;
+        liveInput_ = false;
+        rng_.seed(seed);
+        
+        audioPlayer_ = AudioPlayer::create();
+        if (!audioPlayer_->initializeOffline(channels, sampleRate)) {
+            std::cerr << "Failed to initialize offline audio engine\n";
+            return false;
+        }
+        audioPlayer_->setRandomSeed(seed);
+        
+        audioPlayer_->setMaxConcurrentSounds(config_.audio.maxConcurrentSounds);
+        audioPlayer_->setVoiceStealPolicy(config_.audio.voiceStealing);
+        audioPlayer_->setMasterVolume(config_.audio.masterVolume);
+        audioPlayer_->setAudioEffects(config_.audio.effects);
+        audioPlayer_->setSoundPack(config_.audio.soundPack);
+        audioPlayer_->setSampleLoading(config_.audio.samples);
+        audioPlayer_->preloadSounds(config_.getSoundFiles());
+        keySounds_.build(config_.keyboard, *audioPlayer_);
+        return true;
+    }
+    
+    // Feeds the trace to the input handlers on a virtual clock and writes the mix to a WAV file.
+    // The mix is rendered exactly up to each event's frame, so timing is sample accurate and
+    // independent of how fast the machine is
+    bool renderTrace(const std::vector<InputEvent>& events, const std::string& outputPath) {
+        const uint32_t channels = audioPlayer_->getChannels();
+        const uint32_t sampleRate = audioPlayer_->getSampleRate();
+        const uint64_t kBlockFrames = 512;
+        const uint64_t kTailMs = 2000; // Let the last sounds and the effect tails ring out
+        
+        ma_encoder_config encoderConfig = ma_encoder_config_init(ma_encoding_format_wav, ma_format_f32, channels, sampleRate);
+        ma_encoder encoder;
+        if (ma_encoder_init_file(outputPath.c_str(), &encoderConfig, &encoder) != MA_SUCCESS) {
+            std::cerr << "Could not open output file: " << outputPath << std::endl;
+            return false;
+        }
+        
+        std::vector<float> block(kBlockFrames * channels);
+        uint64_t renderedFrames = 0;
+        double renderCpuSeconds = 0.0;
+        
+        auto renderUntil = [&](uint64_t targetFrame) {
+            while (renderedFrames < targetFrame) {
+                uint64_t frames = std::min(kBlockFrames, targetFrame - renderedFrames);
+                
+                std::clock_t start = std::clock();
+                uint64_t read = audioPlayer_->renderFrames(block.data(), frames);
+                renderCpuSeconds += static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+                if (read == 0) break;
+                
+                ma_encoder_write_pcm_frames(&encoder, block.data(), read, nullptr);
+                renderedFrames += read;
+            }
+        };
+        
+        std::clock_t totalStart = std::clock();
+        for (const InputEvent& event : events) {
+            renderUntil(event.timestampUs * sampleRate / 1000000);
+            
+            if (event.type == InputEvent::MOUSE) {
+                handleMouseEvent(static_cast<MouseButton>(event.code), static_cast<MouseEvent>(event.action), event.timestampUs);
+            } else {
+                handleKeyboardEvent(event.code, static_cast<KeyEvent>(event.action), event.timestampUs);
+            }
         }
         
-        if (config_.keyboard.enabled) {
-            inputMonitor_->setKeyboardCallback([this](int vkCode, KeyEvent event) {
-                handleKeyboardEvent(vkCode, event);
-            });
+        uint64_t endUs = events.empty() ? 0 : events.back().timestampUs;
+        renderUntil((endUs + kTailMs * 1000) * sampleRate / 1000000);
+        double totalCpuSeconds = static_cast<double>(std::clock() - totalStart) / CLOCKS_PER_SEC;
+        
+        ma_encoder_uninit(&encoder);
+        
+        double audioSeconds = static_cast<double>(renderedFrames) / sampleRate;
+        std::cout << "Rendered " << events.size() << " events, " << renderedFrames << " frames ("
+                  << audioSeconds << " s of audio) to " << outputPath << std::endl;
+        std::cout << "Render CPU time: " << renderCpuSeconds << " s mixing, " << totalCpuSeconds << " s total" << std::endl;
+        if (renderCpuSeconds > 0.0) {
+            std::cout << "Throughput: " << static_cast<uint64_t>(renderedFrames / renderCpuSeconds) << " frames per CPU second ("
+                      << audioSeconds / renderCpuSeconds << "x realtime)" << std::endl;
         }
+        return true;
+    }
+    
+    void setPrintLatencyStats(bool enabled) {
+        printLatencyStats_ = enabled;
+    }
+    
+    // Set once, before monitoring starts: the monitor calls them without a lock, so the handlers
+    // check mouse.enabled and keyboard.enabled themselves and a reload never has to swap them
+    void setupCallbacks() {
+        inputMonitor_->clearCallbacks();
         
-        // Set up regular audio updates for fade processing
-        inputMonitor_->setUpdateCallback([this]() {
-            audioPlayer_->update();
+        inputMonitor_->setMouseCallback([this](MouseButton button, MouseEvent event, uint64_t timestampUs) {
+            handleMouseEvent(button, event, timestampUs);
+        });
+        inputMonitor_->setKeyboardCallback([this](int vkCode, KeyEvent event, uint64_t timestampUs) {
+            handleKeyboardEvent(vkCode, event, timestampUs);
         });
     }
     
-    void handleMouseEvent(MouseButton button, MouseEvent event) {
+    // Handlers run on the input dispatcher thread. Debouncing uses the time the event was
+    // received, not the time it was dispatched, so queueing delay can't change what plays
+    void handleMouseEvent(MouseButton button, MouseEvent event, uint64_t timestampUs) {
+        std::lock_guard<std::mutex> lock(inputMutex_);
+        if (!config_.mouse.enabled) return;
+        
         std::string soundFile;
         bool shouldPlay = true;
         
@@ -163,7 +344,7 @@ public:
                 shouldPlay = false;
             } else {
                 // Check debounce timing
-                int currentTime = getCurrentTimeMs();
+                int currentTime = static_cast<int>(timestampUs / 1000);
                 if (currentTime - lastScrollTime_ < config_.mouse.scrollWheelDebounceMs) {
                     shouldPlay = false; // Too soon, skip this scroll event
                 } else {
@@ -175,7 +356,9 @@ public:
         
         // Play the sound if we have one and should play it
         if (shouldPlay && !soundFile.empty()) {
-            int soundId = audioPlayer_->playSoundWithIdAndVolume(soundFile, config_.mouse.volume, config_.audio.asyncPlayback);
+            int soundId = audioPlayer_->playSoundWithIdAndVolume(soundFile, config_.mouse.volume, config_.audio.asyncPlayback,
+                                                               config_.mouse.attackMs, latencyTimestamp(timestampUs),
+                                                               kMouseVoiceKeyBase + static_cast<int>(button), SoundCategory::MOUSE);
             
             // Track the sound ID for potential fade-out (only for button down events)
             if (config_.mouse.enableFadeOut && event == MouseEvent::BUTTON_DOWN && soundId > 0) {
@@ -184,75 +367,94 @@ public:
         }
     }
     
-    void handleKeyboardEvent(int vkCode, KeyEvent event) {
+    void handleKeyboardEvent(int vkCode, KeyEvent event, uint64_t timestampUs) {
+        std::lock_guard<std::mutex> lock(inputMutex_);
+        if (!config_.keyboard.enabled) return;
+        
+        // No keyboard reports codes past the key tables, so there is nothing to track for them
+        if (!KeyStateTable::contains(vkCode)) return;
+        
         // Skip excluded keys
-        if (config_.keyboard.excludedKeys.count(vkCode)) return;
+        if (config_.keyboard.excludedKeys[vkCode]) return;
         
+        KeyState& key = keys_[vkCode];
         if (event == KeyEvent::DOWN) {
-            // Check debounce timing first
-            int currentTime = getCurrentTimeMs();
-            auto lastTimeIt = lastKeyPressTime_.find(vkCode);
-            if (lastTimeIt != lastKeyPressTime_.end()) {
-                if (currentTime - lastTimeIt->second < config_.keyboard.keyRepeatDebounceMs) {
-                    return; // Too soon, skip this key press
-                }
+            // Check debounce timing first; the last press time only counts while the key is held
+            int currentTime = static_cast<int>(timestampUs / 1000);
+            bool held = keys_.isPressed(vkCode);
+            if (held && currentTime - key.lastPressMs < config_.keyboard.keyRepeatDebounceMs) {
+                return; // Too soon, skip this key press
             }
             
             // Check if key repeat should be disabled (global or per-key)
             bool shouldDisableRepeat = config_.keyboard.disableRepeat || 
-                                     config_.keyboard.noRepeatKeys.count(vkCode);
+                                     config_.keyboard.noRepeatKeys[vkCode];
             
-            if (shouldDisableRepeat && pressedKeys_.count(vkCode)) {
+            if (shouldDisableRepeat && held) {
                 return; // Key is already pressed, ignore repeat
             }
             
             // Update timing and pressed keys tracking
-            lastKeyPressTime_[vkCode] = currentTime;
-            pressedKeys_.insert(vkCode);
+            key.lastPressMs = currentTime;
+            keys_.setPressed(vkCode, true);
+            if (!held) {
+                keySounds_.notePress(currentTime);
+            }
             
-            if (!config_.keyboard.sounds.empty()) {
-                int soundIndex;
-
+            KeySample* sample = nullptr;
+            if (keySounds_.hasSet(vkCode)) {
+                // The key's own sounds from key_sounds, by typing speed
+                sample = &keySounds_.pick(vkCode, rng_);
+                lastKeyPressed_ = vkCode;
+            } else if (!keySounds_.defaultSamples().empty()) {
+                std::vector<KeySample>& samples = keySounds_.defaultSamples();
+                
                 if (config_.keyboard.totallyRandomKeypresses) {
                     // True randomization: if switching to a different key, pick a new random sound
                     // If pressing the same key repeatedly, keep using the same sound
-                    if (lastKeyPressed_ != vkCode) {
+                    // (a reload clears the assignment, so the same key can need a new one too)
+                    if (lastKeyPressed_ != vkCode || key.soundIndex < 0) {
                         // Switching keys - pick a new random sound
-                        std::uniform_int_distribution<int> dist(0, static_cast<int>(config_.keyboard.sounds.size()) - 1);
-                        keySoundMap_[vkCode] = dist(rng_);
+                        std::uniform_int_distribution<int> dist(0, static_cast<int>(samples.size()) - 1);
+                        key.soundIndex = dist(rng_);
                         lastKeyPressed_ = vkCode;
                     }
-                    soundIndex = keySoundMap_[vkCode];
                 } else {
                     // Normal random: get or assign random sound for this key (consistent per key)
-                    if (keySoundMap_.find(vkCode) == keySoundMap_.end()) {
-                        std::uniform_int_distribution<int> dist(0, static_cast<int>(config_.keyboard.sounds.size()) - 1);
-                        keySoundMap_[vkCode] = dist(rng_);
+                    if (key.soundIndex < 0) {
+                        std::uniform_int_distribution<int> dist(0, static_cast<int>(samples.size()) - 1);
+                        key.soundIndex = dist(rng_);
                     }
-                    soundIndex = keySoundMap_[vkCode];
                 }
-
-                const std::string& soundFile = config_.keyboard.sounds[soundIndex];
-                int soundId = audioPlayer_->playSoundWithIdAndVolume(soundFile, config_.keyboard.volume, config_.audio.asyncPlayback);
+                sample = &samples[key.soundIndex];
+            }
+            
+            if (sample) {
+                // Resolved on first use, since the table can be built before the sample cache is ready
+                if (!sample->sample) {
+                    sample->sample = audioPlayer_->getSample(sample->filepath);
+                }
+                int soundId = sample->sample
+                    ? audioPlayer_->playSample(sample->sample, config_.keyboard.volume, config_.audio.asyncPlayback,
+                                               config_.keyboard.attackMs, latencyTimestamp(timestampUs), vkCode,
+                                               SoundCategory::KEYBOARD)
+                    : audioPlayer_->playSoundWithIdAndVolume(sample->filepath, config_.keyboard.volume,
+                                                             config_.audio.asyncPlayback, config_.keyboard.attackMs,
+                                                             latencyTimestamp(timestampUs), vkCode, SoundCategory::KEYBOARD);
                 
                 // Track the sound ID for potential fade-out
                 if (config_.keyboard.enableFadeOut && soundId > 0) {
-                    activeKeySounds_[vkCode] = soundId;
+                    key.soundId = soundId;
                 }
             }
         } else if (event == KeyEvent::UP) {
-            pressedKeys_.erase(vkCode);
-            
-            // Clean up timing data for released key to prevent memory buildup
-            lastKeyPressTime_.erase(vkCode);
+            // The last press time goes stale with the held flag
+            keys_.setPressed(vkCode, false);
             
             // Handle fade-out on key release
-            if (config_.keyboard.enableFadeOut) {
-                auto it = activeKeySounds_.find(vkCode);
-                if (it != activeKeySounds_.end()) {
-                    audioPlayer_->fadeOutSound(it->second, config_.keyboard.fadeOutDurationMs);
-                    activeKeySounds_.erase(it);
-                }
+            if (config_.keyboard.enableFadeOut && key.soundId > 0) {
+                audioPlayer_->fadeOutSound(key.soundId, config_.keyboard.fadeOutDurationMs);
+                key.soundId = 0;
             }
         }
     }
@@ -261,12 +463,47 @@ public:
         inputMonitor_->startMonitoring();
     }
     
+    // Called from the signal handler, which may run on any thread. Only wakes the input
+    // loop; run() returns and the caller does the real teardown in stop()
+    void requestStop() {
+        inputMonitor_->stopMonitoring();
+    }
+    
     void stop() {
         running_ = false;
         if (fileWatcher_) {
             fileWatcher_->stopWatching();
         }
-        inputMonitor_->stopMonitoring();
+        
+        SampleCacheStats stats = audioPlayer_->getCacheStats();
+        std::cout << "Sample cache: " << stats.hits << " hits, " << stats.misses << " misses" << std::endl;
+        
+        VoiceStats voiceStats = audioPlayer_->getVoiceStats();
+        std::cout << "Voices: peak " << voiceStats.peakActive << " of " << config_.audio.maxConcurrentSounds << ", "
+                  << voiceStats.steals << " stolen, " << voiceStats.drops << " dropped" << std::endl;
+        
+        // Offline renders have no input monitor
+        if (inputMonitor_) {
+            inputMonitor_->stopMonitoring();
+            
+            InputQueueStats queueStats = inputMonitor_->getQueueStats();
+            std::cout << "Input queue: " << queueStats.dispatched << " events dispatched, max depth "
+                      << queueStats.maxDepth << ", " << queueStats.overflows << " dropped" << std::endl;
+        }
+        
+        if (printLatencyStats_) {
+            std::cout << audioPlayer_->getLatencyStats().report();
+            
+            // What loading did to each sample: lead trim is latency taken out before the attack
+            std::cout << "Samples:" << std::endl;
+            for (const SampleHandle& sample : stats.samples) {
+                std::cout << "  " << sample->filepath << ": " << (sample->pcm16 ? "int16" : "f32") << ", "
+                          << sample->leadTrimFrames * 1000.0 / sample->sampleRate << " ms lead and "
+                          << sample->tailTrimFrames * 1000.0 / sample->sampleRate << " ms tail trimmed, "
+                          << sample->bytesSaved() / 1024.0 << " KiB saved" << std::endl;
+            }
+        }
+        
         audioPlayer_->cleanup();
     }
 };
@@ -275,10 +512,37 @@ ClickSoundsApp* app = nullptr;
 
 void signalHandler(int signal) {
     if (app) {
-        app->stop();
+        app->requestStop();
     }
 }
 
+// --render: replay a recorded input trace through the full audio path into a WAV file
+int renderTraceToFile(const std::string& tracePath, const std::string& outputPath, uint32_t seed, bool printStats) {
+    std::vector<InputEvent> events;
+    if (!InputTrace::load(tracePath, events)) {
+        return 1;
+    }
+    
+    ClickSoundsApp renderApp;
+    renderApp.setPrintLatencyStats(printStats);
+    if (!renderApp.initializeOffline(2, 48000, seed)) {
+        return 1;
+    }
+    
+    bool rendered = renderApp.renderTrace(events, outputPath);
+    renderApp.stop();
+    return rendered ? 0 : 1;
+}
+
+// --bench: offline micro-benchmarks, see benchmarks.cpp
+int runBenchmark(const std::string& name) {
+    if (name == "list") {
+        Benchmarks::list();
+        return 0;
+    }
+    return Benchmarks::run(name);
+}
+
 #ifdef PLATFORM_WINDOWS
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
     bool showConsole = false;
@@ -290,6 +554,25 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     } else if (cmdLine.find("--help") != std::string::npos || cmdLine.find("-h") != std::string::npos) {
         showConsole = true;
     }
+    
+    std::string renderTrace, renderOutput, benchmark;
+    uint32_t renderSeed = 1;
+    bool printStats = false;
+    for (int i = 1; i < __argc; i++) {
+        if (strcmp(__argv[i], "--render") == 0 && i + 2 < __argc) {
+            renderTrace = __argv[++i];
+            renderOutput = __argv[++i];
+            showConsole = true;
+        } else if (strcmp(__argv[i], "--seed") == 0 && i + 1 < __argc) {
+            renderSeed = static_cast<uint32_t>(strtoul(__argv[++i], nullptr, 10));
+        } else if (strcmp(__argv[i], "--stats") == 0) {
+            printStats = true;
+            showConsole = true;
+        } else if (strcmp(__argv[i], "--bench") == 0 && i + 1 < __argc) {
+            benchmark = __argv[++i];
+            showConsole = true;
+        }
+    }
 
     // Allocate console only if requested
     if (showConsole) {
@@ -303,11 +586,22 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
             std::cout << "Usage: ClickSounds [options]\n";
             std::cout << "Options:\n";
             std::cout << "  -f, --foreground    Run with console window (default: background)\n";
+            std::cout << "  --render TRACE OUT  Render an input trace to a WAV file without a sound card\n";
+            std::cout << "  --seed N            Random seed for --render (default: 1)\n";
+            std::cout << "  --stats             Print latency percentiles and per-sample trim stats on exit\n";
+            std::cout << "  --bench NAME        Run a built-in benchmark (NAME = list to show them)\n";
             std::cout << "  -h, --help          Show this help message\n";
             std::cout << "Press any key to exit...\n";
             std::cin.get();
             return 0;
         }
+        
+        if (!renderTrace.empty()) {
+            return renderTraceToFile(renderTrace, renderOutput, renderSeed, printStats);
+        }
+        if (!benchmark.empty()) {
+            return runBenchmark(benchmark);
+        }
 
         std::cout << "ClickSounds started. Press Ctrl+C to exit.\n";
     }
@@ -315,6 +609,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     signal(SIGINT, signalHandler);
 
     app = new ClickSoundsApp();
+    app->setPrintLatencyStats(printStats);
 
     if (!app->initialize()) {
         if (showConsole) {
@@ -325,6 +620,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     }
 
     app->run();
+    app->stop();
 
     delete app;
     return 0;
@@ -332,6 +628,10 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 #else
 int main(int argc, char* argv[]) {
     bool showConsole = true;
+    std::vector<std::string> devicePaths;
+    std::string renderTrace, renderOutput, benchmark;
+    uint32_t renderSeed = 1;
+    bool printStats = false;
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -339,23 +639,48 @@ int main(int argc, char* argv[]) {
             std::cout << "ClickSounds - Keyboard and mouse sound effects\n";
             std::cout << "Usage: ClickSounds [options]\n";
             std::cout << "Options:\n";
+            std::cout << "  -d, --device PATH   Read this input device (repeatable, default: all of /dev/input)\n";
+            std::cout << "  --render TRACE OUT  Render an input trace to a WAV file without a sound card\n";
+            std::cout << "  --seed N            Random seed for --render (default: 1)\n";
+            std::cout << "  --stats             Print latency percentiles and per-sample trim stats on exit\n";
+            std::cout << "  --bench NAME        Run a built-in benchmark (NAME = list to show them)\n";
             std::cout << "  -h, --help          Show this help message\n";
             return 0;
+        } else if ((strcmp(argv[i], "--device") == 0 || strcmp(argv[i], "-d") == 0) && i + 1 < argc) {
+            devicePaths.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--render") == 0 && i + 2 < argc) {
+            renderTrace = argv[++i];
+            renderOutput = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            renderSeed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            printStats = true;
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            benchmark = argv[++i];
         }
     }
+    
+    if (!renderTrace.empty()) {
+        return renderTraceToFile(renderTrace, renderOutput, renderSeed, printStats);
+    }
+    if (!benchmark.empty()) {
+        return runBenchmark(benchmark);
+    }
 
     std::cout << "ClickSounds started. Press Ctrl+C to exit.\n";
 
     signal(SIGINT, signalHandler);
 
     app = new ClickSoundsApp();
+    app->setPrintLatencyStats(printStats);
 
-    if (!app->initialize()) {
+    if (!app->initialize(devicePaths)) {
         delete app;
         return 1;
     }
 
     app->run();
+    app->stop();
 
     delete app;
     return 0;
@@ -0,0 +1,3 @@
+// miniaudio's implementation, in a file of its own so the player and the pack tool share one copy
+#define MINIAUDIO_IMPLEMENTATION
+#include "miniaudio/miniaudio.h"
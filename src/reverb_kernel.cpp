@@ -0,0 +1,100 @@
+#include "reverb_kernel.h"
+#include "reverb_kernel_impl.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define REVERB_KERNEL_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define REVERB_KERNEL_NEON
+#endif
+
+// Defined in reverb_kernel_avx.cpp, the one file built with AVX code generation
+bool reverb_kernel_avx_built();
+void reverb_kernel_avx_process(verblib* verb, const float* input, float* output, unsigned long frames);
+
+#ifdef REVERB_KERNEL_X86
+static bool cpu_has_avx() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && (_xgetbv(0) & 6) == 6;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    bool osxsave = (ecx & (1u << 27)) != 0;
+    bool avx = (ecx & (1u << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    
+    // The OS also has to save the upper halves of the YMM registers on context switches
+    unsigned int xcr0Low, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    return (xcr0Low & 6) == 6;
+#endif
+}
+#endif
+
+bool ReverbKernel::supported(Kind kind) {
+    switch (kind) {
+        case SCALAR:
+            return true;
+#ifdef REVERB_KERNEL_X86
+        case SSE2:
+            return true; // Part of the x86-64 baseline
+        case AVX: {
+            static const bool avx = reverb_kernel_avx_built() && cpu_has_avx();
+            return avx;
+        }
+#endif
+#ifdef REVERB_KERNEL_NEON
+        case NEON:
+            return true; // Part of the AArch64 baseline
+#endif
+        default:
+            return false;
+    }
+}
+
+ReverbKernel::Kind ReverbKernel::best() {
+    static const Kind kind = supported(AVX) ? AVX : supported(SSE2) ? SSE2 : supported(NEON) ? NEON : SCALAR;
+    return kind;
+}
+
+const char* ReverbKernel::name(Kind kind) {
+    switch (kind) {
+        case SSE2: return "SSE2";
+        case AVX: return "AVX";
+        case NEON: return "NEON";
+        default: return "scalar";
+    }
+}
+
+void ReverbKernel::process(Kind kind, verblib* verb, const float* input, float* output, unsigned long frames) {
+    if (!chunked_layout(verb) || !supported(kind)) {
+        kind = SCALAR;
+    }
+    
+    switch (kind) {
+#ifdef REVERB_KERNEL_X86
+        case SSE2:
+            process_chunked<Sse2Vec>(verb, input, output, frames);
+            break;
+        case AVX:
+            reverb_kernel_avx_process(verb, input, output, frames);
+            break;
+#endif
+#ifdef REVERB_KERNEL_NEON
+        case NEON:
+            process_chunked<NeonVec>(verb, input, output, frames);
+            break;
+#endif
+        default:
+            verblib_process(verb, input, output, frames);
+            break;
+    }
+}
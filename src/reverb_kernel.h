@@ -0,0 +1,25 @@
+#pragma once
+#include "miniaudio/verblib.h"
+
+// Vectorized replacements for verblib_process. They run on the same verblib state (buffers,
+// indices, filter memory and settings), so kernels can be swapped at any time and the result
+// matches verblib_process: bit for bit on x86, within float rounding where the compiler fuses
+// multiply-adds in verblib's scalar code (ARM).
+//
+// Blocks of up to 64 frames are processed at once. That is shorter than every delay line, so a
+// block's delay taps are all known up front: the 16 comb filters (8 per side) only carry their
+// one-pole damping filter from frame to frame, which runs with one comb per vector lane, and the
+// allpasses have no recursion within a block at all and are vectorized over frames.
+class ReverbKernel {
+public:
+    enum Kind { SCALAR, SSE2, AVX, NEON };
+    
+    // Fastest kernel the running CPU supports, checked once
+    static Kind best();
+    static bool supported(Kind kind);
+    static const char* name(Kind kind);
+    
+    // Same contract as verblib_process. Layouts other than stereo summed to mono (the only one
+    // ReverbNode uses) fall back to verblib_process
+    static void process(Kind kind, verblib* verb, const float* input, float* output, unsigned long frames);
+};
@@ -0,0 +1,21 @@
+// Built with AVX code generation (see premake5.lua) and only entered after ReverbKernel has
+// checked the CPU. Without the flag the kernel compiles out and AVX is reported unsupported
+#include "reverb_kernel_impl.h"
+
+#ifdef __AVX__
+bool reverb_kernel_avx_built() {
+    return true;
+}
+
+void reverb_kernel_avx_process(verblib* verb, const float* input, float* output, unsigned long frames) {
+    process_chunked<AvxVec>(verb, input, output, frames);
+}
+#else
+bool reverb_kernel_avx_built() {
+    return false;
+}
+
+void reverb_kernel_avx_process(verblib* verb, const float* input, float* output, unsigned long frames) {
+    verblib_process(verb, input, output, frames);
+}
+#endif
@@ -0,0 +1,323 @@
+#pragma once
+// Shared body of the vectorized reverb kernels. Only included by reverb_kernel.cpp and by
+// reverb_kernel_avx.cpp, which is compiled with AVX enabled. Everything in here has internal
+// linkage so the two builds of it never get mixed up at link time.
+#include "miniaudio/verblib.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const int kCombLanes = verblib_numcombs * 2; // Left combs in lanes 0-7, right in 8-15
+
+// Frames per chunk. Every delay line is longer than this (the shortest allpass is 112 frames at
+// verblib's lowest rate), so nothing written inside a chunk is read back inside the same chunk:
+// all the taps of a chunk can be loaded up front and all the writes stored afterwards
+const int kChunkFrames = 64;
+
+// Vector traits. Each provides the lane count, the handful of float ops the kernel needs and an
+// in-register transpose of a kWidth x kWidth block
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+struct Sse2Vec {
+    typedef __m128 T;
+    static const int kWidth = 4;
+    static T load(const float* p) { return _mm_load_ps(p); }
+    static T loadu(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, T v) { _mm_store_ps(p, v); }
+    static void storeu(float* p, T v) { _mm_storeu_ps(p, v); }
+    static T set1(float value) { return _mm_set1_ps(value); }
+    static T add(T a, T b) { return _mm_add_ps(a, b); }
+    static T sub(T a, T b) { return _mm_sub_ps(a, b); }
+    static T mul(T a, T b) { return _mm_mul_ps(a, b); }
+    static void transpose(T* rows) { _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]); }
+};
+#endif
+
+#ifdef __AVX__
+struct AvxVec {
+    typedef __m256 T;
+    static const int kWidth = 8;
+    static T load(const float* p) { return _mm256_load_ps(p); }
+    static T loadu(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, T v) { _mm256_store_ps(p, v); }
+    static void storeu(float* p, T v) { _mm256_storeu_ps(p, v); }
+    static T set1(float value) { return _mm256_set1_ps(value); }
+    static T add(T a, T b) { return _mm256_add_ps(a, b); }
+    static T sub(T a, T b) { return _mm256_sub_ps(a, b); }
+    static T mul(T a, T b) { return _mm256_mul_ps(a, b); }
+    
+    static void transpose(T* rows) {
+        __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+        __m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+        __m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+        __m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+        __m256 t4 = _mm256_unpacklo_ps(rows[4], rows[5]);
+        __m256 t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+        __m256 t6 = _mm256_unpacklo_ps(rows[6], rows[7]);
+        __m256 t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+        __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+        rows[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+        rows[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+        rows[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+        rows[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+        rows[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+        rows[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+        rows[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+        rows[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+    }
+};
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+struct NeonVec {
+    typedef float32x4_t T;
+    static const int kWidth = 4;
+    static T load(const float* p) { return vld1q_f32(p); }
+    static T loadu(const float* p) { return vld1q_f32(p); }
+    static void store(float* p, T v) { vst1q_f32(p, v); }
+    static void storeu(float* p, T v) { vst1q_f32(p, v); }
+    static T set1(float value) { return vdupq_n_f32(value); }
+    static T add(T a, T b) { return vaddq_f32(a, b); }
+    static T sub(T a, T b) { return vsubq_f32(a, b); }
+    static T mul(T a, T b) { return vmulq_f32(a, b); }
+    
+    static void transpose(T* rows) {
+        float32x4x2_t t01 = vtrnq_f32(rows[0], rows[1]);
+        float32x4x2_t t23 = vtrnq_f32(rows[2], rows[3]);
+        rows[0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+        rows[1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+        rows[2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+        rows[3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+    }
+};
+#endif
+
+// verblib's denormal guard, which also rounds the value to the precision of 1.0f
+inline float undenormalise(float sample) {
+    sample += 1.0f;
+    sample -= 1.0f;
+    return sample;
+}
+
+template <typename V>
+inline typename V::T undenormalise(typename V::T sample, typename V::T one) {
+    return V::sub(V::add(sample, one), one);
+}
+
+inline verblib_comb& comb_at(verblib* verb, int lane) {
+    return lane < verblib_numcombs ? verb->combL[lane] : verb->combR[lane - verblib_numcombs];
+}
+
+// Copies count frames of a ring buffer starting at index into a flat array, and back
+inline void read_ring(const float* ring, int size, int index, float* out, int count) {
+    int first = std::min(count, size - index);
+    std::memcpy(out, ring + index, first * sizeof(float));
+    std::memcpy(out + first, ring, (count - first) * sizeof(float));
+}
+
+inline void write_ring(float* ring, int size, int index, const float* in, int count) {
+    int first = std::min(count, size - index);
+    std::memcpy(ring + index, in, first * sizeof(float));
+    std::memcpy(ring, in + first, (count - first) * sizeof(float));
+}
+
+// One allpass over a chunk, in place. The taps are all older than the chunk, so the frames are
+// independent and run kWidth at a time straight out of the delay line
+template <typename V>
+void allpass_chunk(verblib_allpass& allpass, float* samples, int count) {
+    const typename V::T one = V::set1(1.0f);
+    const typename V::T feedback = V::set1(allpass.feedback);
+    
+    int frame = 0;
+    while (frame < count) {
+        int segment = std::min(count - frame, allpass.bufsize - allpass.bufidx);
+        float* ring = allpass.buffer + allpass.bufidx;
+        float* x = samples + frame;
+        
+        int i = 0;
+        for (; i + V::kWidth <= segment; i += V::kWidth) {
+            typename V::T input = V::loadu(x + i);
+            typename V::T bufout = undenormalise<V>(V::loadu(ring + i), one);
+            V::storeu(ring + i, V::add(input, V::mul(bufout, feedback)));
+            V::storeu(x + i, V::sub(bufout, input));
+        }
+        for (; i < segment; i++) {
+            float input = x[i];
+            float bufout = undenormalise(ring[i]);
+            ring[i] = input + (bufout * allpass.feedback);
+            x[i] = -input + bufout;
+        }
+        
+        frame += segment;
+        allpass.bufidx += segment;
+        if (allpass.bufidx >= allpass.bufsize) {
+            allpass.bufidx = 0;
+        }
+    }
+}
+
+// verblib_process for stereo input summed to mono, a chunk at a time:
+//   1. Load each comb's taps for the chunk into a row (lane-major).
+//   2. Sum the rows per side in verblib's comb order, so the sums round exactly the same way.
+//   3. Run the one-pole damping filters, the only recursion in a comb. Blocks of kWidth rows are
+//      transposed so one vector holds one frame of kWidth combs, stepped frame by frame, and
+//      transposed back into the values to write.
+//   4. Store the rows back into the delay lines and run the allpasses over the sums.
+template <typename V>
+void process_chunked(verblib* verb, const float* input, float* output, unsigned long frames) {
+    const int W = V::kWidth;
+    const typename V::T one = V::set1(1.0f);
+    
+    alignas(32) float rows[kCombLanes][kChunkFrames];
+    alignas(32) float mono[kChunkFrames];
+    alignas(32) float sumL[kChunkFrames];
+    alignas(32) float sumR[kChunkFrames];
+    alignas(32) float filterstore[kCombLanes];
+    alignas(32) float damp1[kCombLanes];
+    alignas(32) float damp2[kCombLanes];
+    alignas(32) float feedback[kCombLanes];
+    for (int lane = 0; lane < kCombLanes; lane++) {
+        const verblib_comb& comb = comb_at(verb, lane);
+        filterstore[lane] = comb.filterstore;
+        damp1[lane] = comb.damp1;
+        damp2[lane] = comb.damp2;
+        feedback[lane] = comb.feedback;
+    }
+    
+    while (frames > 0) {
+        const int count = static_cast<int>(std::min<unsigned long>(frames, kChunkFrames));
+        const int vectorCount = count / W * W;
+        
+        for (int frame = 0; frame < count; frame++) {
+            mono[frame] = (input[frame * 2] + input[frame * 2 + 1]) * verb->gain;
+        }
+        
+        // 1. Taps, with the denormal guard applied
+        for (int lane = 0; lane < kCombLanes; lane++) {
+            const verblib_comb& comb = comb_at(verb, lane);
+            float* row = rows[lane];
+            read_ring(comb.buffer, comb.bufsize, comb.bufidx, row, count);
+            int frame = 0;
+            for (; frame < vectorCount; frame += W) {
+                V::store(row + frame, undenormalise<V>(V::load(row + frame), one));
+            }
+            for (; frame < count; frame++) {
+                row[frame] = undenormalise(row[frame]);
+            }
+        }
+        
+        // 2. Comb outputs summed per side
+        {
+            int frame = 0;
+            for (; frame < vectorCount; frame += W) {
+                typename V::T left = V::set1(0.0f);
+                typename V::T right = V::set1(0.0f);
+                for (int i = 0; i < verblib_numcombs; i++) {
+                    left = V::add(left, V::load(rows[i] + frame));
+                    right = V::add(right, V::load(rows[verblib_numcombs + i] + frame));
+                }
+                V::store(sumL + frame, left);
+                V::store(sumR + frame, right);
+            }
+            for (; frame < count; frame++) {
+                float left = 0.0f;
+                float right = 0.0f;
+                for (int i = 0; i < verblib_numcombs; i++) {
+                    left += rows[i][frame];
+                    right += rows[verblib_numcombs + i][frame];
+                }
+                sumL[frame] = left;
+                sumR[frame] = right;
+            }
+        }
+        
+        // 3. Damping filters; each row turns into the values written back to its delay line
+        for (int lane0 = 0; lane0 < kCombLanes; lane0 += W) {
+            typename V::T store = V::load(filterstore + lane0);
+            const typename V::T d1 = V::load(damp1 + lane0);
+            const typename V::T d2 = V::load(damp2 + lane0);
+            const typename V::T fb = V::load(feedback + lane0);
+            
+            for (int frame0 = 0; frame0 < vectorCount; frame0 += W) {
+                typename V::T block[W];
+                for (int i = 0; i < W; i++) {
+                    block[i] = V::load(rows[lane0 + i] + frame0);
+                }
+                V::transpose(block);
+                for (int i = 0; i < W; i++) {
+                    store = undenormalise<V>(V::add(V::mul(block[i], d2), V::mul(store, d1)), one);
+                    block[i] = V::add(V::set1(mono[frame0 + i]), V::mul(store, fb));
+                }
+                V::transpose(block);
+                for (int i = 0; i < W; i++) {
+                    V::store(rows[lane0 + i] + frame0, block[i]);
+                }
+            }
+            V::store(filterstore + lane0, store);
+            
+            for (int lane = lane0; lane < lane0 + W; lane++) {
+                for (int frame = vectorCount; frame < count; frame++) {
+                    filterstore[lane] = undenormalise((rows[lane][frame] * damp2[lane]) + (filterstore[lane] * damp1[lane]));
+                    rows[lane][frame] = mono[frame] + (filterstore[lane] * feedback[lane]);
+                }
+            }
+        }
+        
+        // 4. Delay line writes, then the allpasses in series
+        for (int lane = 0; lane < kCombLanes; lane++) {
+            verblib_comb& comb = comb_at(verb, lane);
+            write_ring(comb.buffer, comb.bufsize, comb.bufidx, rows[lane], count);
+            comb.bufidx += count;
+            if (comb.bufidx >= comb.bufsize) {
+                comb.bufidx -= comb.bufsize;
+            }
+        }
+        for (int i = 0; i < verblib_numallpasses; i++) {
+            allpass_chunk<V>(verb->allpassL[i], sumL, count);
+            allpass_chunk<V>(verb->allpassR[i], sumR, count);
+        }
+        
+        for (int frame = 0; frame < count; frame++) {
+            output[frame * 2] = sumL[frame] * verb->wet1 + sumR[frame] * verb->wet2 + input[frame * 2] * verb->dry;
+            output[frame * 2 + 1] = sumR[frame] * verb->wet1 + sumL[frame] * verb->wet2 + input[frame * 2 + 1] * verb->dry;
+        }
+        
+        input += count * 2;
+        output += count * 2;
+        frames -= count;
+    }
+    
+    for (int lane = 0; lane < kCombLanes; lane++) {
+        comb_at(verb, lane).filterstore = filterstore[lane];
+    }
+}
+
+// The chunked kernel handles stereo input summed to mono (ReverbNode's layout) with delay lines
+// longer than a chunk. Anything else goes to verblib_process
+inline bool chunked_layout(const verblib* verb) {
+    if (verb->channels != 2 || verb->input_width > 0.0f) return false;
+    for (int i = 0; i < verblib_numallpasses; i++) {
+        if (verb->allpassL[i].bufsize <= kChunkFrames || verb->allpassR[i].bufsize <= kChunkFrames) return false;
+    }
+    return true;
+}
+
+} // namespace
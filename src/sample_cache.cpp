@@ -0,0 +1,352 @@
+#include "sample_cache.h"
+#include "config.h"
+#include "loudness_cache.h"
+#include "miniaudio/miniaudio.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+
+// Decoding is mostly CPU-bound, but a handful of threads is plenty for a sound set and leaves the
+// rest of the machine alone
+static const unsigned kMaxLoaderThreads = 4;
+
+size_t CachedSample::bytesSaved() const {
+    size_t whole = (leadTrimFrames + frameCount + tailTrimFrames) * channels * sizeof(float);
+    size_t stored = pack ? frameCount * channels * sizeof(float) // Trimmed pages are never touched
+                         : frames.size() * sizeof(float) + frames16.size() * sizeof(int16_t);
+    return whole - stored;
+}
+
+SampleCache::SampleCache() : format_(SampleFormat::AUTO) {}
+
+// Brings the sample to the target loudness, but never so far that its peak would clip
+static float normalization_gain(float loudnessDb, float peakDb, float targetLoudnessDb) {
+    if (!std::isfinite(loudnessDb)) return 1.0f; // Silent
+    float gainDb = std::min(targetLoudnessDb - loudnessDb, -peakDb);
+    return std::pow(10.0f, gainDb / 20.0f);
+}
+
+SampleCache::~SampleCache() {
+    waitForLoader();
+}
+
+void SampleCache::setOutputFormat(uint32_t channels, uint32_t sampleRate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (channels == channels_ && sampleRate == sampleRate_) return;
+
+    channels_ = channels;
+    sampleRate_ = sampleRate;
+    samples_ = std::make_shared<SampleSet>();
+    streamLevels_.reset(); // Measured at the old format
+    pack_.reset(); // Only matches the old format
+    generation_++;
+}
+
+bool SampleCache::setPack(std::shared_ptr<const SoundPack> pack) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pack && (pack->channels() != channels_ || pack->sampleRate() != sampleRate_)) {
+        std::cerr << "Sound pack " << pack->path() << " holds " << pack->channels() << " channels at "
+                  << pack->sampleRate() << " Hz but the output is " << channels_ << " channels at " << sampleRate_
+                  << " Hz, decoding the sound files instead" << std::endl;
+        pack.reset();
+    }
+    if (pack == pack_) return pack != nullptr;
+
+    pack_ = std::move(pack);
+    samples_ = std::make_shared<SampleSet>();
+    generation_++;
+    return pack_ != nullptr;
+}
+
+bool SampleCache::setLoadOptions(float trimThreshold, SampleFormat format, bool normalize, float targetLoudnessDb) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (trimThreshold == trimThreshold_ && format == format_ && normalize == normalize_ &&
+        (!normalize || targetLoudnessDb == targetLoudnessDb_)) return false;
+
+    trimThreshold_ = trimThreshold;
+    format_ = format;
+    normalize_ = normalize;
+    targetLoudnessDb_ = targetLoudnessDb;
+    samples_ = std::make_shared<SampleSet>();
+    generation_++;
+    return true;
+}
+
+// Pack samples are trimmed by narrowing the view of the mapped PCM, so they cost nothing extra
+SampleHandle SampleCache::load(const std::string& filepath, const LoadParams& params, const LoudnessCache* levels) {
+    const SoundPackEntry* entry = params.pack ? params.pack->find(SoundPack::normalizeName(filepath)) : nullptr;
+    if (!entry) return decode(filepath, params, levels);
+
+    auto sample = std::make_shared<CachedSample>();
+    sample->filepath = filepath;
+    sample->pcm = params.pack->frames(*entry);
+    sample->pack = params.pack;
+    sample->channels = params.channels;
+    sample->sampleRate = params.sampleRate;
+    sample->frameCount = entry->frameCount;
+    if (params.normalize) {
+        // Measured when the pack was built
+        sample->loudnessDb = entry->loudnessDb;
+        sample->peakDb = entry->peakDb;
+        sample->gain = normalization_gain(sample->loudnessDb, sample->peakDb, params.targetLoudnessDb);
+    }
+
+    if (params.trimThreshold > 0.0f) {
+        uint64_t start, end;
+        SoundPack::audibleRange(sample->pcm, entry->frameCount, params.channels, params.trimThreshold, start, end);
+        if (end > 0) {
+            sample->pcm += start * params.channels;
+            sample->frameCount = end - start;
+            sample->leadTrimFrames = start;
+            sample->tailTrimFrames = entry->frameCount - end;
+        }
+    }
+    return sample;
+}
+
+SampleHandle SampleCache::decode(const std::string& filepath, const LoadParams& params, const LoudnessCache* levels) {
+    // Convert straight to the engine format so playback never has to resample or convert
+    const uint32_t channels = params.channels;
+    ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_f32, channels, params.sampleRate);
+    ma_uint64 frameCount = 0;
+    void* pcm = nullptr;
+
+    ma_result result = ma_decode_file(filepath.c_str(), &decoderConfig, &frameCount, &pcm);
+    if (result != MA_SUCCESS) {
+        std::cerr << "Failed to decode sound file: " << filepath << " (" << result << ")" << std::endl;
+        return nullptr;
+    }
+    const float* samples = static_cast<const float*>(pcm);
+
+    auto sample = std::make_shared<CachedSample>();
+    sample->filepath = filepath;
+    sample->channels = channels;
+    sample->sampleRate = params.sampleRate;
+    if (params.normalize) {
+        LoudnessCache::Level level;
+        if (!levels || !levels->find(filepath, level)) {
+            SoundPack::measureLevel(samples, frameCount, channels, level.loudnessDb, level.peakDb);
+        }
+        sample->loudnessDb = level.loudnessDb;
+        sample->peakDb = level.peakDb;
+        sample->gain = normalization_gain(sample->loudnessDb, sample->peakDb, params.targetLoudnessDb);
+    }
+
+    // Only the audible part is kept; a sample that is silent throughout is kept whole
+    uint64_t start = 0, end = frameCount;
+    if (params.trimThreshold > 0.0f) {
+        SoundPack::audibleRange(samples, frameCount, channels, params.trimThreshold, start, end);
+        if (end == 0) end = frameCount;
+    }
+    sample->frameCount = end - start;
+    sample->leadTrimFrames = start;
+    sample->tailTrimFrames = frameCount - end;
+    const float* first = samples + start * channels;
+    const float* last = samples + end * channels;
+
+    // The decoder turns 16-bit sources into exact multiples of 1/32768, so unless resampling or
+    // channel mixing got in between, int16 holds the same PCM in half the memory
+    bool int16 = params.format == SampleFormat::INT16;
+    if (params.format == SampleFormat::AUTO) {
+        int16 = std::all_of(first, last, [](float value) {
+            float scaled = value * 32768.0f;
+            return scaled == std::nearbyint(scaled) && scaled >= -32768.0f && scaled <= 32767.0f;
+        });
+    }
+
+    if (int16) {
+        sample->frames16.resize(last - first);
+        std::transform(first, last, sample->frames16.begin(), [](float value) {
+            return static_cast<int16_t>(std::clamp(std::lrint(value * 32768.0f), -32768L, 32767L));
+        });
+        sample->pcm16 = sample->frames16.data();
+    } else {
+        sample->frames.assign(first, last);
+        sample->pcm = sample->frames.data();
+    }
+    ma_free(pcm, nullptr);
+
+    return sample;
+}
+
+void SampleCache::waitForLoader() {
+    std::lock_guard<std::mutex> lock(loaderMutex_);
+    if (loader_.joinable()) {
+        loader_.join();
+    }
+}
+
+void SampleCache::preloadAsync(const std::vector<std::string>& filepaths, std::function<void(int)> onReady) {
+    std::lock_guard<std::mutex> loaderLock(loaderMutex_);
+    if (loader_.joinable()) {
+        loader_.join();
+    }
+
+    std::shared_ptr<const SampleSet> current;
+    LoadParams params;
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current = samples_;
+        params = {pack_, channels_, sampleRate_, trimThreshold_, format_, normalize_, targetLoudnessDb_};
+        generation = generation_;
+    }
+
+    loader_ = std::thread([this, filepaths, onReady, current, params, generation]() {
+        auto next = std::make_shared<SampleSet>();
+        std::vector<std::string> toLoad;
+        for (const auto& filepath : filepaths) {
+            if (next->count(filepath)) continue;
+            auto it = current->find(filepath);
+            if (it != current->end() && it->second) {
+                (*next)[filepath] = it->second;
+            } else {
+                (*next)[filepath] = nullptr; // Reserved, filled in below
+                toLoad.push_back(filepath);
+            }
+        }
+
+        // Loudness of decoded files is looked up in their directory's cache file and only measured
+        // on a miss. The caches are read before the workers start and written after they finish
+        LevelCaches levels;
+        auto directory = [](const std::string& filepath) { return std::filesystem::path(filepath).parent_path().string(); };
+        if (params.normalize) {
+            for (const std::string& filepath : toLoad) {
+                levels.try_emplace(directory(filepath), directory(filepath), params.channels, params.sampleRate);
+            }
+
+            // What was cached is also what files streamed until this load is published play at
+            auto known = std::make_shared<const LevelCaches>(levels);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (generation == generation_) streamLevels_ = known;
+        }
+
+        // Workers take files off a shared counter and fill their own slots, so they never contend
+        std::vector<SampleHandle> loaded(toLoad.size());
+        std::atomic<size_t> nextFile{0};
+        auto work = [&]() {
+            for (size_t i = nextFile.fetch_add(1); i < toLoad.size(); i = nextFile.fetch_add(1)) {
+                auto it = levels.find(directory(toLoad[i]));
+                loaded[i] = load(toLoad[i], params, it != levels.end() ? &it->second : nullptr);
+            }
+        };
+        unsigned threadCount = std::min<unsigned>({kMaxLoaderThreads, std::max(1u, std::thread::hardware_concurrency()),
+                                                   static_cast<unsigned>(toLoad.size())});
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threadCount; t++) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        int failed = 0;
+        for (size_t i = 0; i < toLoad.size(); i++) {
+            (*next)[toLoad[i]] = loaded[i];
+            if (!loaded[i]) failed++;
+            if (params.normalize && loaded[i] && !loaded[i]->pack) {
+                levels.at(directory(toLoad[i])).store(toLoad[i], {loaded[i]->loudnessDb, loaded[i]->peakDb});
+            }
+        }
+        for (auto& pair : levels) {
+            pair.second.save();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (generation != generation_) return; // Decoded for a format or pack that's gone
+            samples_ = next;
+        }
+        if (onReady) onReady(failed);
+    });
+}
+
+int SampleCache::preload(const std::vector<std::string>& filepaths) {
+    int failed = 0;
+    preloadAsync(filepaths, [&failed](int count) { failed = count; });
+    waitForLoader();
+    return failed;
+}
+
+SampleHandle SampleCache::find(const std::string& filepath, bool* failed) const {
+    std::shared_ptr<const SampleSet> samples;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples = samples_;
+    }
+
+    auto it = samples->find(filepath);
+    if (failed) *failed = it != samples->end() && !it->second;
+    if (it != samples->end() && it->second) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return it->second;
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+bool SampleCache::streamGain(const std::string& filepath, float& gain) const {
+    std::shared_ptr<const SoundPack> pack;
+    std::shared_ptr<const LevelCaches> levels;
+    float targetLoudnessDb;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        gain = 1.0f;
+        if (!normalize_) return true;
+        pack = pack_;
+        levels = streamLevels_;
+        targetLoudnessDb = targetLoudnessDb_;
+    }
+
+    LoudnessCache::Level level;
+    const SoundPackEntry* entry = pack ? pack->find(SoundPack::normalizeName(filepath)) : nullptr;
+    if (entry) {
+        level = {entry->loudnessDb, entry->peakDb};
+    } else {
+        if (!levels) return false;
+        auto it = levels->find(std::filesystem::path(filepath).parent_path().string());
+        if (it == levels->end() || !it->second.find(filepath, level)) return false;
+    }
+    gain = normalization_gain(level.loudnessDb, level.peakDb, targetLoudnessDb);
+    return true;
+}
+
+void SampleCache::forget(const std::vector<std::string>& filepaths) {
+    waitForLoader();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto next = std::make_shared<SampleSet>(*samples_);
+    for (const std::string& filepath : filepaths) {
+        next->erase(filepath);
+    }
+    samples_ = next;
+}
+
+void SampleCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples_ = std::make_shared<SampleSet>();
+    generation_++;
+}
+
+SampleCacheStats SampleCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    SampleCacheStats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    for (const auto& pair : *samples_) {
+        const SampleHandle& sample = pair.second;
+        if (!sample) continue;
+        stats.sampleCount++;
+        stats.memoryBytes += sample->frames.size() * sizeof(float) + sample->frames16.size() * sizeof(int16_t);
+        if (sample->pack) stats.packSamples++;
+        if (sample->pcm16) stats.int16Samples++;
+        stats.bytesSaved += sample->bytesSaved();
+        stats.samples.push_back(sample);
+    }
+    std::sort(stats.samples.begin(), stats.samples.end(),
+              [](const SampleHandle& a, const SampleHandle& b) { return a->filepath < b->filepath; });
+    return stats;
+}
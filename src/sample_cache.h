@@ -0,0 +1,132 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include "sound_pack.h"
+
+class LoudnessCache;
+
+enum class SampleFormat;
+
+// A sound file decoded once into interleaved PCM at the engine's output format, or the same PCM
+// served straight from a mapped sound pack. Leading silence and the inaudible tail are already cut
+// off, so frame 0 is the start of the transient
+struct CachedSample {
+    std::string filepath;
+    const float* pcm = nullptr; // f32 PCM: into frames, or into the pack's mapped pages
+    const int16_t* pcm16 = nullptr; // Set instead of pcm when the sample is stored as int16
+    std::vector<float> frames; // Empty for pack samples
+    std::vector<int16_t> frames16;
+    std::shared_ptr<const SoundPack> pack; // Keeps the mapping alive while the sample is in use
+    uint32_t channels = 0;
+    uint32_t sampleRate = 0;
+    uint64_t frameCount = 0; // After trimming
+    uint64_t leadTrimFrames = 0; // Silence cut from the start, i.e. latency before the attack
+    uint64_t tailTrimFrames = 0;
+    float loudnessDb = 0.0f; // As SoundPack::measureLevel() reports them, only measured when normalizing
+    float peakDb = 0.0f;
+    float gain = 1.0f; // Loudness normalization, applied to every play of the sample
+
+    // Memory the untrimmed f32 decode would take that this sample doesn't
+    size_t bytesSaved() const;
+};
+
+// What the player holds on to while a sample plays, and what callers can keep to skip the lookup by path
+using SampleHandle = std::shared_ptr<const CachedSample>;
+
+struct SampleCacheStats {
+    uint64_t hits = 0;      // Lookups served from memory
+    uint64_t misses = 0;    // Lookups for samples that weren't loaded (yet)
+    size_t sampleCount = 0;
+    size_t memoryBytes = 0; // Decoded PCM on the heap
+    size_t packSamples = 0; // Served from the sound pack's mapped pages
+    size_t int16Samples = 0;
+    size_t bytesSaved = 0;  // By trimming and int16 storage, against untrimmed f32
+    std::vector<SampleHandle> samples; // Everything loaded, by path, for per-sample reports
+};
+
+// Samples are loaded in the background as a set: a preload decodes (and resamples) its files on a
+// few worker threads into a new set, then publishes it in place of the old one in a single step.
+// Lookups never decode; they see either the old set or the new one
+class SampleCache {
+public:
+    SampleCache();
+    ~SampleCache();
+
+    // Changing the format drops everything decoded so far
+    void setOutputFormat(uint32_t channels, uint32_t sampleRate);
+
+    // Serve samples from a pack before decoding files, or stop using one with null. The pack has to
+    // be in the output format. Changing it drops everything cached so far
+    bool setPack(std::shared_ptr<const SoundPack> pack);
+
+    // Trim threshold as a linear level (0 keeps samples whole), storage format and loudness
+    // normalization for loaded samples. Changing them drops everything cached so far (and returns true)
+    bool setLoadOptions(float trimThreshold, SampleFormat format, bool normalize, float targetLoudnessDb);
+
+    // Starts loading exactly these files and returns at once. Samples already in the current set are
+    // carried over instead of decoded again. onReady gets the number of files that failed to load and
+    // runs on the loader thread after the new set is published. Waits for a load still in progress
+    void preloadAsync(const std::vector<std::string>& filepaths, std::function<void(int)> onReady = nullptr);
+
+    // preloadAsync that waits for the new set. Returns the number of files that failed to load
+    int preload(const std::vector<std::string>& filepaths);
+
+    // The sample from the published set. Null while it is still loading, if it failed to load
+    // (failed is set then) or if no preload asked for it
+    SampleHandle find(const std::string& filepath, bool* failed = nullptr) const;
+
+    // Loudness normalization gain for playing a file that isn't in the published set, e.g. streaming
+    // it while the cache loads: 1 when not normalizing, otherwise from the pack or from the loudness
+    // cache files the running load read. False if the file's level isn't known until it is measured
+    bool streamGain(const std::string& filepath, float& gain) const;
+
+    // Takes these files out of the published set, so the next preload decodes them again. Waits for a
+    // load still in progress, which could otherwise publish them again
+    void forget(const std::vector<std::string>& filepaths);
+
+    void clear();
+    SampleCacheStats getStats() const;
+
+private:
+    using SampleSet = std::unordered_map<std::string, SampleHandle>; // Null for files that failed to load
+    using LevelCaches = std::unordered_map<std::string, LoudnessCache>; // By directory
+
+    // Everything a load depends on, taken when it starts
+    struct LoadParams {
+        std::shared_ptr<const SoundPack> pack;
+        uint32_t channels;
+        uint32_t sampleRate;
+        float trimThreshold;
+        SampleFormat format;
+        bool normalize;
+        float targetLoudnessDb;
+    };
+
+    void waitForLoader();
+    // From the pack, or decoded. levels has the file's directory when normalizing
+    static SampleHandle load(const std::string& filepath, const LoadParams& params, const LoudnessCache* levels);
+    static SampleHandle decode(const std::string& filepath, const LoadParams& params, const LoudnessCache* levels);
+
+    mutable std::mutex mutex_;
+    std::shared_ptr<const SampleSet> samples_ = std::make_shared<SampleSet>(); // Published set, replaced whole
+    std::shared_ptr<const LevelCaches> streamLevels_; // Read by the latest load, for streamGain
+    uint64_t generation_ = 0; // Bumped when the format or pack changes, so a load in flight isn't published
+    std::thread loader_;
+    std::mutex loaderMutex_; // Serializes starting and joining loader_
+    std::shared_ptr<const SoundPack> pack_;
+    uint32_t channels_ = 2;
+    uint32_t sampleRate_ = 48000;
+    float trimThreshold_ = 0.0f;
+    SampleFormat format_;
+    bool normalize_ = false;
+    float targetLoudnessDb_ = 0.0f;
+    mutable std::atomic<uint64_t> hits_{0};
+    mutable std::atomic<uint64_t> misses_{0};
+};
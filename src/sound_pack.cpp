@@ -0,0 +1,253 @@
+#include "sound_pack.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef PLATFORM_WINDOWS
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Quieter than this (-60 dBFS) counts as silence when finding the trim points
+static const float kSilenceThreshold = 0.001f;
+
+static float to_db(double level) {
+    return level > 0.0 ? static_cast<float>(20.0 * std::log10(level)) : -INFINITY;
+}
+
+static uint64_t align_up(uint64_t offset) {
+    return (offset + kSoundPackAlignment - 1) / kSoundPackAlignment * kSoundPackAlignment;
+}
+
+std::string SoundPack::normalizeName(std::string_view path) {
+    std::string name(path);
+    std::replace(name.begin(), name.end(), '\\', '/');
+    while (name.compare(0, 2, "./") == 0) {
+        name.erase(0, 2);
+    }
+    return name;
+}
+
+void SoundPack::audibleRange(const float* frames, uint64_t frameCount, uint32_t channels, float threshold,
+                             uint64_t& start, uint64_t& end) {
+    auto loud = [&](uint64_t frame) {
+        for (uint32_t c = 0; c < channels; c++) {
+            if (std::fabs(frames[frame * channels + c]) > threshold) return true;
+        }
+        return false;
+    };
+    start = 0;
+    while (start < frameCount && !loud(start)) start++;
+    end = frameCount;
+    while (end > start && !loud(end - 1)) end--;
+    if (start == end) start = end = 0;
+}
+
+void SoundPack::measureLevel(const float* frames, uint64_t frameCount, uint32_t channels, float& loudnessDb, float& peakDb) {
+    // Silence around the sound would only dilute the RMS
+    uint64_t start, end;
+    audibleRange(frames, frameCount, channels, kSilenceThreshold, start, end);
+    
+    double sumSquares = 0.0;
+    float peak = 0.0f;
+    for (uint64_t n = start * channels; n < end * channels; n++) {
+        sumSquares += static_cast<double>(frames[n]) * frames[n];
+        peak = std::max(peak, std::fabs(frames[n]));
+    }
+    uint64_t count = (end - start) * channels;
+    loudnessDb = to_db(count > 0 ? std::sqrt(sumSquares / count) : 0.0);
+    peakDb = to_db(peak);
+}
+
+std::shared_ptr<const SoundPack> SoundPack::open(const std::string& path) {
+    std::shared_ptr<SoundPack> pack(new SoundPack());
+    pack->path_ = path;
+    
+#ifdef PLATFORM_WINDOWS
+    // Shared for delete so clicksounds-pack can rename a rebuilt pack over this one
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Could not open sound pack: " << path << std::endl;
+        return nullptr;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    HANDLE mapping = fileSize.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    CloseHandle(file); // The mapping keeps the file open
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        std::cerr << "Could not map sound pack: " << path << std::endl;
+        return nullptr;
+    }
+    pack->mapping_ = mapping;
+    pack->data_ = static_cast<const uint8_t*>(view);
+    pack->size_ = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Could not open sound pack: " << path << std::endl;
+        return nullptr;
+    }
+    struct stat info;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd); // The mapping keeps the file open
+    if (view == MAP_FAILED) {
+        std::cerr << "Could not map sound pack: " << path << std::endl;
+        return nullptr;
+    }
+    pack->data_ = static_cast<const uint8_t*>(view);
+    pack->size_ = static_cast<size_t>(info.st_size);
+    
+    // Start reading the pages in now rather than on the first keystroke that needs them
+    madvise(view, pack->size_, MADV_WILLNEED);
+#endif
+    
+    if (!pack->validate()) {
+        std::cerr << "Not a valid sound pack: " << path << std::endl;
+        return nullptr;
+    }
+    return pack;
+}
+
+SoundPack::~SoundPack() {
+    if (!data_) return;
+#ifdef PLATFORM_WINDOWS
+    UnmapViewOfFile(data_);
+    CloseHandle(static_cast<HANDLE>(mapping_));
+#else
+    munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+}
+
+// Everything the accessors rely on, so a damaged or foreign file is rejected up front instead of
+// being read out of bounds later
+bool SoundPack::validate() const {
+    if (size_ < sizeof(SoundPackHeader)) return false;
+    const SoundPackHeader& head = header();
+    if (std::memcmp(head.magic, kSoundPackMagic, sizeof(kSoundPackMagic)) != 0) return false;
+    if (head.version != kSoundPackVersion || head.fileSize != size_) return false;
+    if (head.channels == 0 || head.sampleRate == 0) return false;
+    
+    uint64_t entriesEnd = sizeof(SoundPackHeader) + static_cast<uint64_t>(head.entryCount) * sizeof(SoundPackEntry);
+    if (entriesEnd > size_ || head.namesOffset < entriesEnd || head.namesOffset > size_ ||
+        head.namesSize > size_ - head.namesOffset) return false;
+    
+    for (size_t i = 0; i < head.entryCount; i++) {
+        const SoundPackEntry& e = entries()[i];
+        if (static_cast<uint64_t>(e.nameOffset) + e.nameLength > head.namesSize) return false;
+        if (e.dataOffset % kSoundPackAlignment != 0 || e.dataOffset > size_) return false;
+        if (e.frameCount > (size_ - e.dataOffset) / (sizeof(float) * head.channels)) return false;
+        if (e.trimStart > e.trimEnd || e.trimEnd > e.frameCount) return false;
+        if (i > 0 && !(name(entries()[i - 1]) < name(e))) return false; // find() needs them sorted and unique
+    }
+    return true;
+}
+
+std::string_view SoundPack::name(const SoundPackEntry& entry) const {
+    return std::string_view(reinterpret_cast<const char*>(data_ + header().namesOffset + entry.nameOffset), entry.nameLength);
+}
+
+const float* SoundPack::frames(const SoundPackEntry& entry) const {
+    return reinterpret_cast<const float*>(data_ + entry.dataOffset);
+}
+
+const SoundPackEntry* SoundPack::find(std::string_view name) const {
+    const SoundPackEntry* begin = entries();
+    const SoundPackEntry* end = begin + size();
+    const SoundPackEntry* it = std::lower_bound(begin, end, name, [this](const SoundPackEntry& entry, std::string_view key) {
+        return this->name(entry) < key;
+    });
+    return it != end && this->name(*it) == name ? it : nullptr;
+}
+
+bool SoundPack::write(const std::string& path, uint32_t channels, uint32_t sampleRate, std::vector<SoundPackSample> samples) {
+    std::sort(samples.begin(), samples.end(), [](const SoundPackSample& a, const SoundPackSample& b) {
+        return a.name < b.name;
+    });
+    for (size_t i = 1; i < samples.size(); i++) {
+        if (samples[i].name == samples[i - 1].name) {
+            std::cerr << "Sample added to the pack twice: " << samples[i].name << std::endl;
+            return false;
+        }
+    }
+    
+    SoundPackHeader head = {};
+    std::memcpy(head.magic, kSoundPackMagic, sizeof(kSoundPackMagic));
+    head.version = kSoundPackVersion;
+    head.channels = channels;
+    head.sampleRate = sampleRate;
+    head.entryCount = static_cast<uint32_t>(samples.size());
+    head.namesOffset = sizeof(SoundPackHeader) + samples.size() * sizeof(SoundPackEntry);
+    
+    std::string names;
+    std::vector<SoundPackEntry> entries(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+        const SoundPackSample& sample = samples[i];
+        SoundPackEntry& e = entries[i];
+        e.frameCount = sample.frames.size() / channels;
+        e.nameOffset = static_cast<uint32_t>(names.size());
+        e.nameLength = static_cast<uint32_t>(sample.name.size());
+        names += sample.name;
+        
+        audibleRange(sample.frames.data(), e.frameCount, channels, kSilenceThreshold, e.trimStart, e.trimEnd);
+        measureLevel(sample.frames.data(), e.frameCount, channels, e.loudnessDb, e.peakDb);
+    }
+    head.namesSize = names.size();
+    
+    uint64_t offset = align_up(head.namesOffset + head.namesSize);
+    for (SoundPackEntry& e : entries) {
+        e.dataOffset = offset;
+        offset = align_up(offset + e.frameCount * channels * sizeof(float));
+    }
+    head.fileSize = offset;
+    
+    // Written beside the real file and renamed over it: a running ClickSounds has the old pack mapped,
+    // and truncating it would pull the pages out from under the audio thread
+    std::string tempPath = path + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Could not create sound pack: " << tempPath << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&head), sizeof(head));
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SoundPackEntry));
+    file.write(names.data(), names.size());
+    
+    static const char padding[kSoundPackAlignment] = {};
+    uint64_t written = head.namesOffset + head.namesSize;
+    for (size_t i = 0; i < samples.size(); i++) {
+        file.write(padding, entries[i].dataOffset - written);
+        size_t bytes = entries[i].frameCount * channels * sizeof(float);
+        file.write(reinterpret_cast<const char*>(samples[i].frames.data()), bytes);
+        written = entries[i].dataOffset + bytes;
+    }
+    file.write(padding, head.fileSize - written);
+    file.close();
+    
+    std::error_code error;
+    if (!file) {
+        std::cerr << "Failed writing sound pack: " << tempPath << std::endl;
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::cerr << "Could not replace sound pack " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A sound pack is one file holding many samples already decoded to interleaved f32 PCM at the
+// engine's output format. It is memory-mapped and played straight from the mapped pages, so loading
+// it costs one mmap and the PCM is shared between processes and can be paged out when idle.
+//
+// Layout, little-endian: SoundPackHeader, then entryCount SoundPackEntry records sorted by name,
+// then the names, then each sample's PCM starting on a kSoundPackAlignment boundary
+constexpr char kSoundPackMagic[8] = {'C', 'L', 'K', 'P', 'A', 'C', 'K', 0};
+constexpr uint32_t kSoundPackVersion = 1;
+constexpr uint64_t kSoundPackAlignment = 64; // Cache line, and enough for any SIMD load
+
+struct SoundPackHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t channels;
+    uint32_t sampleRate;
+    uint32_t entryCount;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+    uint64_t fileSize; // Catches truncated files before anything is read past the end
+};
+
+struct SoundPackEntry {
+    uint64_t dataOffset;  // From the start of the file
+    uint64_t frameCount;
+    uint64_t trimStart;   // First frame above the silence threshold
+    uint64_t trimEnd;     // One past the last frame above it, 0 if the sample is silent
+    uint32_t nameOffset;  // Into the names block
+    uint32_t nameLength;
+    float loudnessDb;     // RMS between the trim points, dBFS
+    float peakDb;         // dBFS
+};
+
+static_assert(sizeof(SoundPackHeader) == 48, "SoundPackHeader is part of the file format");
+static_assert(sizeof(SoundPackEntry) == 48, "SoundPackEntry is part of the file format");
+
+// A sample to write into a pack
+struct SoundPackSample {
+    std::string name;
+    std::vector<float> frames; // Interleaved, at the pack's channel count
+};
+
+class SoundPack {
+public:
+    // Maps and validates a pack. Returns null (with the reason on stderr) if it can't be used
+    static std::shared_ptr<const SoundPack> open(const std::string& path);
+    
+    // Writes samples as a pack, working out the trim points and loudness of each
+    static bool write(const std::string& path, uint32_t channels, uint32_t sampleRate, std::vector<SoundPackSample> samples);
+    
+    // Names are paths as the config spells them, with forward slashes and no leading "./"
+    static std::string normalizeName(std::string_view path);
+    
+    // First frame where any channel rises above threshold (linear) and one past the last, {0, 0} if
+    // the whole sample stays below it
+    static void audibleRange(const float* frames, uint64_t frameCount, uint32_t channels, float threshold,
+                             uint64_t& start, uint64_t& end);
+    
+    // RMS loudness of the part above -60 dBFS and peak, in dBFS (-infinity for silence), as entries
+    // record them
+    static void measureLevel(const float* frames, uint64_t frameCount, uint32_t channels, float& loudnessDb, float& peakDb);
+    
+    ~SoundPack();
+    SoundPack(const SoundPack&) = delete;
+    SoundPack& operator=(const SoundPack&) = delete;
+    
+    const std::string& path() const { return path_; }
+    uint32_t channels() const { return header().channels; }
+    uint32_t sampleRate() const { return header().sampleRate; }
+    size_t size() const { return header().entryCount; }
+    size_t mappedBytes() const { return size_; }
+    
+    const SoundPackEntry& entry(size_t index) const { return entries()[index]; }
+    std::string_view name(const SoundPackEntry& entry) const;
+    const float* frames(const SoundPackEntry& entry) const;
+    
+    // Takes a normalized name, null if the pack doesn't have it
+    const SoundPackEntry* find(std::string_view name) const;
+
+private:
+    SoundPack() = default;
+    bool validate() const;
+    const SoundPackHeader& header() const { return *reinterpret_cast<const SoundPackHeader*>(data_); }
+    const SoundPackEntry* entries() const { return reinterpret_cast<const SoundPackEntry*>(data_ + sizeof(SoundPackHeader)); }
+    
+    std::string path_;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    void* mapping_ = nullptr; // HANDLE of the file mapping on Windows
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <array>
+#include <atomic>
+
+// Latest-value mailbox between exactly one writer thread and one reader thread. The writer can
+// publish as often as it likes and the reader always gets the most recent complete value; neither
+// side blocks, so it is safe for handing parameter blocks to the audio thread.
+template <typename T>
+class TripleBuffer {
+public:
+    // Only while neither side is running
+    void reset(const T& initial) {
+        buffers_.fill(initial);
+        middle_.store(1, std::memory_order_relaxed);
+        back_ = 0;
+        front_ = 2;
+    }
+    
+    // Writer side. Replaces any value the reader hasn't picked up yet
+    void write(const T& value) {
+        buffers_[back_] = value;
+        int previous = middle_.exchange(back_ | kDirty, std::memory_order_acq_rel);
+        back_ = previous & kIndexMask;
+    }
+    
+    // Reader side. Returns false when nothing new was written since the last read
+    bool read(T& value) {
+        if (!(middle_.load(std::memory_order_relaxed) & kDirty)) {
+            return false;
+        }
+        int previous = middle_.exchange(front_, std::memory_order_acq_rel);
+        front_ = previous & kIndexMask;
+        value = buffers_[front_];
+        return true;
+    }
+
+private:
+    static constexpr int kIndexMask = 3;
+    static constexpr int kDirty = 4;
+    
+    std::array<T, 3> buffers_{};
+    std::atomic<int> middle_{1}; // Slot index handed between the two sides, plus the dirty flag
+    int back_ = 0;  // Owned by the writer
+    int front_ = 2; // Owned by the reader
+};
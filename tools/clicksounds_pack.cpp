@@ -0,0 +1,109 @@
+// clicksounds-pack: decodes sound files once and writes them to a sound pack that ClickSounds maps
+// instead of decoding the files at every start (audio.sound_pack in config.json)
+#include "sound_pack.h"
+#include "miniaudio/miniaudio.h"
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static bool is_sound_file(const fs::path& path) {
+    std::string ext = path.extension().string();
+    return ext == ".wav" || ext == ".mp3" || ext == ".ogg" || ext == ".flac" || ext == ".m4a";
+}
+
+static void print_usage() {
+    std::cout << "Usage: clicksounds-pack [--channels N] [--sample-rate HZ] OUTPUT FILE_OR_DIR...\n\n"
+              << "Decodes the sound files (directories are searched recursively) to the playback format and\n"
+              << "writes them to OUTPUT. Samples are found by path, so run it from the directory ClickSounds\n"
+              << "runs in and pass the paths the way config.json spells them, e.g. sounds/keyboard.\n"
+              << "The format has to match the output device; the defaults, 2 channels at 48000 Hz, are what\n"
+              << "most devices run at. A pack that doesn't match is ignored and the files are decoded instead\n";
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t channels = 2;
+    uint32_t sampleRate = 48000;
+    std::string output;
+    std::vector<fs::path> inputs;
+    
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--channels") == 0 && i + 1 < argc) {
+            channels = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--sample-rate") == 0 && i + 1 < argc) {
+            sampleRate = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+            print_usage();
+            return 0;
+        } else if (output.empty()) {
+            output = argv[i];
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (output.empty() || inputs.empty() || channels == 0 || sampleRate == 0) {
+        print_usage();
+        return 1;
+    }
+    
+    std::vector<fs::path> files;
+    for (const fs::path& input : inputs) {
+        std::error_code error;
+        if (fs::is_directory(input, error)) {
+            for (const auto& entry : fs::recursive_directory_iterator(input, error)) {
+                if (entry.is_regular_file() && is_sound_file(entry.path())) {
+                    files.push_back(entry.path());
+                }
+            }
+        } else if (fs::is_regular_file(input, error)) {
+            files.push_back(input);
+        } else {
+            std::cerr << "Not found: " << input.string() << std::endl;
+            return 1;
+        }
+    }
+    
+    std::vector<SoundPackSample> samples;
+    uint64_t totalFrames = 0;
+    for (const fs::path& file : files) {
+        ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_f32, channels, sampleRate);
+        ma_uint64 frameCount = 0;
+        void* pcm = nullptr;
+        ma_result result = ma_decode_file(file.string().c_str(), &decoderConfig, &frameCount, &pcm);
+        if (result != MA_SUCCESS) {
+            std::cerr << "Failed to decode sound file: " << file.string() << " (" << result << ")" << std::endl;
+            return 1;
+        }
+        
+        SoundPackSample sample;
+        sample.name = SoundPack::normalizeName(file.string());
+        const float* frames = static_cast<const float*>(pcm);
+        sample.frames.assign(frames, frames + frameCount * channels);
+        ma_free(pcm, nullptr);
+        
+        totalFrames += frameCount;
+        samples.push_back(std::move(sample));
+    }
+    
+    if (!SoundPack::write(output, channels, sampleRate, std::move(samples))) {
+        return 1;
+    }
+    
+    // Read it back the way the player will, which also checks the file
+    std::shared_ptr<const SoundPack> pack = SoundPack::open(output);
+    if (!pack) return 1;
+    for (size_t i = 0; i < pack->size(); i++) {
+        const SoundPackEntry& entry = pack->entry(i);
+        std::cout << "  " << pack->name(entry) << ": " << entry.frameCount << " frames, audible "
+                  << entry.trimStart << "-" << entry.trimEnd << ", " << entry.loudnessDb << " dBFS RMS, "
+                  << entry.peakDb << " dBFS peak" << std::endl;
+    }
+    std::cout << "Packed " << pack->size() << " samples (" << totalFrames << " frames, "
+              << pack->mappedBytes() / 1024 << " KiB) at " << channels << " channels, " << sampleRate
+              << " Hz into " << output << std::endl;
+    return 0;
+}